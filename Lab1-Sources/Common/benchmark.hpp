@@ -0,0 +1,240 @@
+/*--------------------------------------------------------------------
+ **
+ ** Name:    benchmark.hpp
+ **
+ ** Purpose: Statistical benchmark driver. Each registered variant is
+ **          run a few times untimed (JIT, first touch of the pages,
+ **          caches), then timed over several repetitions, and its rate
+ **          is summarised by min/median/mean/p95/stddev.
+ **
+ **          A variant is a function that performs the operation once
+ **          and returns its duration in seconds, so that it can report
+ **          a device time (see profiling.hpp) rather than wall clock.
+ **
+ ** Usage:   util::Benchmark bench(warmup, repetitions);
+ **          bench.add("mmul", N, 2.0*N*N*N*1e-9, "GFLOPS", run, check);
+ **          bench.run();
+ **          bench.print(); bench.writeCSV(file); bench.writeJSON(file);
+ **
+ **--------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace util {
+
+  //! Summary of the rates of the timed repetitions of a variant
+  struct BenchmarkStats
+  {
+    double min;    // slowest repetition
+    double median;
+    double mean;
+    double p95;    // rate reached by 95% of the repetitions
+    double max;    // fastest repetition
+    double stddev;
+  };
+
+  //! Statistics of a set of rates
+  inline BenchmarkStats computeStats(std::vector<double> rates)
+  {
+    BenchmarkStats s = { 0, 0, 0, 0, 0, 0 };
+    size_t n = rates.size();
+    if (n == 0)
+      return s;
+
+    std::sort(rates.begin(), rates.end());
+    s.min = rates[0];
+    s.max = rates[n - 1];
+    s.median = (n % 2) ? rates[n / 2] : 0.5 * (rates[n / 2 - 1] + rates[n / 2]);
+    // 5th percentile of the rate = 95th percentile of the run time
+    s.p95 = rates[(size_t) std::floor(0.05 * (n - 1))];
+
+    for (size_t i = 0; i < n; i++)
+      s.mean += rates[i];
+    s.mean /= n;
+
+    for (size_t i = 0; i < n; i++)
+      s.stddev += (rates[i] - s.mean) * (rates[i] - s.mean);
+    s.stddev = n > 1 ? std::sqrt(s.stddev / (n - 1)) : 0.0;
+
+    return s;
+  }
+
+  class Benchmark
+  {
+    public:
+      //! Runs fn once, returns its duration in seconds
+      typedef std::function<double()> Run;
+      //! Validates the result of the last run
+      typedef std::function<bool()> Check;
+
+      struct Result
+      {
+        std::string         name;
+        long long           size;
+        std::string         unit;
+        std::vector<double> times;  // seconds, one per repetition
+        BenchmarkStats      stats;  // of work / time
+        bool                valid;
+      };
+
+      Benchmark(unsigned warmup = 2, unsigned repetitions = 10)
+        : warmup_(warmup), repetitions_(repetitions > 0 ? repetitions : 1)
+      {
+      }
+
+      /*!
+       * \brief Registers a variant.
+       * \param size  problem size, only reported
+       * \param work  amount of work of one run, in unit * seconds
+       *              (e.g. 1e-9 * flop for GFLOPS)
+       */
+      void add(const std::string& name, long long size, double work,
+               const std::string& unit, const Run& run, const Check& check = Check())
+      {
+        Variant v = { name, size, work, unit, run, check };
+        variants_.push_back(v);
+      }
+
+      /*!
+       * \brief Runs every variant registered since the last call. The
+       * variants are dropped as they are taken, so that no run or check
+       * function, which may refer to the caller's locals, is kept past
+       * this call, and one that throws is not run again.
+       */
+      void run(std::ostream& log = std::cout)
+      {
+        std::vector<Variant> pending;
+        pending.swap(variants_);
+        for (size_t v = 0; v < pending.size(); v++) {
+          const Variant& var = pending[v];
+          Result r;
+          r.name = var.name;
+          r.size = var.size;
+          r.unit = var.unit;
+
+          for (unsigned i = 0; i < warmup_; i++)
+            var.run();
+
+          std::vector<double> rates;
+          for (unsigned i = 0; i < repetitions_; i++) {
+            double t = var.run();
+            r.times.push_back(t);
+            rates.push_back(t > 0.0 ? var.work / t : 0.0);
+          }
+          r.stats = computeStats(rates);
+          r.valid = var.check ? var.check() : true;
+
+          char line[256];
+          snprintf(line, sizeof(line), " %-24s %10lld  median %10.2f %s  [min %.2f, p95 %.2f, max %.2f, sd %.2f]%s\n",
+                   r.name.c_str(), r.size, r.stats.median, r.unit.c_str(),
+                   r.stats.min, r.stats.p95, r.stats.max, r.stats.stddev,
+                   r.valid ? "" : "  WRONG RESULT");
+          log << line << std::flush;
+
+          results_.push_back(r);
+        }
+      }
+
+      const std::vector<Result>& results() const { return results_; }
+
+      //! Table of all the results
+      void print(std::ostream& out = std::cout) const
+      {
+        char line[256];
+        snprintf(line, sizeof(line), "\n %-24s %10s %8s %10s %10s %10s %10s %10s %10s  %s\n",
+                 "variant", "size", "unit", "min", "median", "mean", "p95", "max", "stddev", "check");
+        out << line;
+        for (size_t i = 0; i < results_.size(); i++) {
+          const Result& r = results_[i];
+          snprintf(line, sizeof(line), " %-24s %10lld %8s %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f  %s\n",
+                   r.name.c_str(), r.size, r.unit.c_str(),
+                   r.stats.min, r.stats.median, r.stats.mean, r.stats.p95, r.stats.max, r.stats.stddev,
+                   r.valid ? "ok" : "WRONG");
+          out << line;
+        }
+      }
+
+      //! One line per variant, with a header
+      void writeCSV(std::ostream& out) const
+      {
+        out << "variant,size,unit,warmup,repetitions,min,median,mean,p95,max,stddev,median_time_s,valid\n";
+        for (size_t i = 0; i < results_.size(); i++) {
+          const Result& r = results_[i];
+          out << r.name << "," << r.size << "," << r.unit << ","
+              << warmup_ << "," << repetitions_ << ","
+              << r.stats.min << "," << r.stats.median << "," << r.stats.mean << ","
+              << r.stats.p95 << "," << r.stats.max << "," << r.stats.stddev << ","
+              << medianTime(r) << "," << (r.valid ? 1 : 0) << "\n";
+        }
+      }
+
+      //! Array of objects, with the raw times of each repetition
+      void writeJSON(std::ostream& out) const
+      {
+        out << "[\n";
+        for (size_t i = 0; i < results_.size(); i++) {
+          const Result& r = results_[i];
+          out << "  {\"variant\": \"" << r.name << "\", \"size\": " << r.size
+              << ", \"unit\": \"" << r.unit << "\""
+              << ", \"warmup\": " << warmup_ << ", \"repetitions\": " << repetitions_
+              << ", \"min\": " << r.stats.min << ", \"median\": " << r.stats.median
+              << ", \"mean\": " << r.stats.mean << ", \"p95\": " << r.stats.p95
+              << ", \"max\": " << r.stats.max << ", \"stddev\": " << r.stats.stddev
+              << ", \"valid\": " << (r.valid ? "true" : "false")
+              << ", \"times\": [";
+          for (size_t t = 0; t < r.times.size(); t++)
+            out << (t ? ", " : "") << r.times[t];
+          out << "]}" << (i + 1 < results_.size() ? "," : "") << "\n";
+        }
+        out << "]\n";
+      }
+
+      //! Writes CSV or JSON to path depending on its extension
+      bool save(const std::string& path) const
+      {
+        std::ofstream out(path.c_str());
+        if (!out)
+          return false;
+        if (path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0)
+          writeJSON(out);
+        else
+          writeCSV(out);
+        return true;
+      }
+
+    private:
+      struct Variant
+      {
+        std::string name;
+        long long   size;
+        double      work;
+        std::string unit;
+        Run         run;
+        Check       check;
+      };
+
+      static double medianTime(const Result& r)
+      {
+        std::vector<double> t(r.times);
+        std::sort(t.begin(), t.end());
+        size_t n = t.size();
+        return n == 0 ? 0.0 : (n % 2) ? t[n / 2] : 0.5 * (t[n / 2 - 1] + t[n / 2]);
+      }
+
+      unsigned             warmup_;
+      unsigned             repetitions_;
+      std::vector<Variant> variants_;
+      std::vector<Result>  results_;
+  };
+
+} // namespace util
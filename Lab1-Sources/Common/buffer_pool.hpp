@@ -0,0 +1,192 @@
+/*--------------------------------------------------------------------
+ **
+ ** Name:    buffer_pool.hpp
+ **
+ ** Purpose: Pool of device buffers on a context, so that repeated
+ **          operations on the same sizes allocate no device memory.
+ **
+ **          Requests are rounded up to a size class (4 classes per
+ **          power of 2, so at most 25% larger) and served from the
+ **          free buffers of that class before creating a new one.
+ **          Released buffers go back to their class, and are freed by
+ **          trim() or with the pool.
+ **
+ **          The pool also tracks which host arrays are resident on the
+ **          device: resident() uploads a host array the first time and
+ **          then returns the same buffer without copying, until the
+ **          host side is marked as changed by invalidate().
+ **
+ ** Usage:   util::BufferPool pool(context);
+ **          cl::Buffer d_a = pool.resident(queue, h_a.data(), bytes);
+ **          cl::Buffer d_c = pool.acquire(bytes);
+ **          ...
+ **          pool.release(d_c);
+ **          pool.evict(h_a.data());
+ **
+ ** Note:    Must be included AFTER the relevant OpenCL header
+ **
+ **--------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace util {
+
+  class BufferPool
+  {
+    public:
+      //! Counters of the pool, for reports
+      struct Stats
+      {
+        size_t allocations;  // buffers created on the device
+        size_t reuses;       // requests served from the free buffers
+        size_t uploads;      // host to device copies made by resident()
+        size_t hits;         // resident() calls served without a copy
+        size_t bytesHeld;    // device memory held by the pool
+        size_t bytesInUse;   // of which acquired or resident
+      };
+
+      BufferPool(const cl::Context& context, cl_mem_flags flags = CL_MEM_READ_WRITE)
+        : context_(context), flags_(flags)
+      {
+        Stats s = { 0, 0, 0, 0, 0, 0 };
+        stats_ = s;
+      }
+
+      //! Smallest size class holding bytes
+      static size_t sizeClass(size_t bytes)
+      {
+        size_t size = 4096;
+        while (size < bytes) {
+          // 4096, 5120, 6144, 7168, 8192, 10240, ...
+          size_t step = size / 4;
+          for (int i = 0; i < 4 && size < bytes; i++)
+            size += step;
+        }
+        return size;
+      }
+
+      //! Buffer of at least bytes, from the free buffers if possible
+      cl::Buffer acquire(size_t bytes)
+      {
+        size_t size = sizeClass(bytes);
+        std::vector<cl::Buffer>& free = free_[size];
+        cl::Buffer buffer;
+        if (!free.empty()) {
+          buffer = free.back();
+          free.pop_back();
+          stats_.reuses++;
+        }
+        else {
+          buffer = cl::Buffer(context_, flags_, size);
+          stats_.allocations++;
+          stats_.bytesHeld += size;
+        }
+        stats_.bytesInUse += size;
+        return buffer;
+      }
+
+      //! Gives back a buffer obtained from acquire
+      void release(const cl::Buffer& buffer)
+      {
+        size_t size = buffer.getInfo<CL_MEM_SIZE>();
+        free_[size].push_back(buffer);
+        stats_.bytesInUse -= size;
+      }
+
+      /*!
+       * \brief Device copy of host[0, bytes). The first call (or the
+       * first after invalidate) uploads through queue, blocking; the
+       * next ones return the resident buffer as is.
+       */
+      cl::Buffer resident(cl::CommandQueue& queue, const void* host, size_t bytes)
+      {
+        std::map<const void*, Resident>::iterator it = resident_.find(host);
+        if (it != resident_.end() && it->second.bytes != bytes) {
+          evict(host);
+          it = resident_.end();
+        }
+        if (it == resident_.end()) {
+          Resident r = { acquire(bytes), bytes, false };
+          it = resident_.insert(std::make_pair(host, r)).first;
+        }
+
+        Resident& r = it->second;
+        if (r.valid) {
+          stats_.hits++;
+        }
+        else {
+          queue.enqueueWriteBuffer(r.buffer, CL_TRUE, 0, bytes, host);
+          r.valid = true;
+          stats_.uploads++;
+        }
+        return r.buffer;
+      }
+
+      //! The host array changed: the next resident() uploads it again
+      //! (into the same buffer)
+      void invalidate(const void* host)
+      {
+        std::map<const void*, Resident>::iterator it = resident_.find(host);
+        if (it != resident_.end())
+          it->second.valid = false;
+      }
+
+      //! Whether host is on the device and up to date
+      bool isResident(const void* host) const
+      {
+        std::map<const void*, Resident>::const_iterator it = resident_.find(host);
+        return it != resident_.end() && it->second.valid;
+      }
+
+      //! Stops tracking host and gives its buffer back to the pool
+      void evict(const void* host)
+      {
+        std::map<const void*, Resident>::iterator it = resident_.find(host);
+        if (it != resident_.end()) {
+          release(it->second.buffer);
+          resident_.erase(it);
+        }
+      }
+
+      //! Frees the buffers that are not in use
+      void trim()
+      {
+        std::map<size_t, std::vector<cl::Buffer> >::iterator it;
+        for (it = free_.begin(); it != free_.end(); ++it)
+          stats_.bytesHeld -= it->first * it->second.size();
+        free_.clear();
+      }
+
+      const Stats& stats() const { return stats_; }
+
+      //! One line summary of the counters
+      void printStats(const std::string& label) const
+      {
+        printf(" %s: %lu device allocations, %lu reuses, %lu uploads, %lu resident hits, %.1f MB held\n",
+               label.c_str(), (unsigned long) stats_.allocations, (unsigned long) stats_.reuses,
+               (unsigned long) stats_.uploads, (unsigned long) stats_.hits,
+               stats_.bytesHeld / (1024.0 * 1024.0));
+      }
+
+    private:
+      struct Resident
+      {
+        cl::Buffer buffer;
+        size_t     bytes;
+        bool       valid;   // same content as the host array
+      };
+
+      cl::Context                                  context_;
+      cl_mem_flags                                 flags_;
+      std::map<size_t, std::vector<cl::Buffer> >   free_;      // by size class
+      std::map<const void*, Resident>              resident_;  // by host array
+      Stats                                        stats_;
+  };
+
+} // namespace util
@@ -12,8 +12,14 @@
 #pragma once
 
 #include <vector>
+#include <algorithm>
 #include <err_code.h>
 #include <iostream>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <cerrno>
 
 #define MAX_INFO_STRING 256
 
@@ -60,7 +66,169 @@ int parseUInt(const char *str, cl_uint *output)
   return !strlen(next);
 }
 
-void parseArguments(int argc, char *argv[], cl_uint *deviceIndex)
+// Options common to the drivers, on top of the device selection.
+// Fields left at their defaults keep the values chosen by the driver.
+//
+// A driver registers its own options with addFlag, addNumber, addList
+// and addChoice before parseArguments, which then lists them in --help,
+// sets their targets and stops on a missing or invalid value.
+struct RunOptions
+{
+  // Option of a single driver: one of flag, number, list or text is set
+  struct Extra
+  {
+    std::string           name;     // e.g. "--threads"
+    std::string           arg;      // value shown by --help, "" for a flag
+    std::string           help;
+    bool                 *flag;     // true when given
+    size_t               *number;   // within [min, max]
+    size_t                min, max;
+    std::vector<size_t>  *list;     // numbers "I,J,..." within [min, max]
+    std::string          *text;     // one of choices, "a|b|c"
+    std::string           choices;
+  };
+
+  std::vector<size_t> sizes;      // problem sizes, in order
+  bool                sizeGiven;  // whether --size was given
+  unsigned            warmup;     // untimed runs before the timed ones
+  unsigned            iterations; // timed runs
+  std::string         variant;    // variant to run ("" = the driver default)
+  std::string         output;     // CSV/JSON file for the results
+  std::vector<Extra>  extras;     // options of the driver
+
+  RunOptions(size_t size, unsigned warmup_ = 2, unsigned iterations_ = 10)
+    : sizes(1, size), sizeGiven(false), warmup(warmup_), iterations(iterations_)
+  {
+  }
+
+  //! The option of the driver named name, NULL if there is none
+  const Extra* findExtra(const char *name) const
+  {
+    for (size_t e = 0; e < extras.size(); e++)
+      if (extras[e].name == name)
+        return &extras[e];
+    return NULL;
+  }
+
+  void addFlag(const char *name, const char *help, bool *target)
+  {
+    Extra e = { name, "", help, target, NULL, 0, 0, NULL, NULL, "" };
+    extras.push_back(e);
+  }
+
+  void addNumber(const char *name, const char *arg, const char *help, size_t *target,
+                 size_t min = 1, size_t max = (size_t) -1)
+  {
+    Extra e = { name, arg, help, NULL, target, min, max, NULL, NULL, "" };
+    extras.push_back(e);
+  }
+
+  void addList(const char *name, const char *arg, const char *help, std::vector<size_t> *target,
+               size_t min = 0, size_t max = (size_t) -1)
+  {
+    Extra e = { name, arg, help, NULL, NULL, min, max, target, NULL, "" };
+    extras.push_back(e);
+  }
+
+  void addChoice(const char *name, const char *arg, const char *help, std::string *target,
+                 const char *choices)
+  {
+    Extra e = { name, arg, help, NULL, NULL, 0, 0, NULL, target, choices };
+    extras.push_back(e);
+  }
+};
+
+// Parses a whole decimal number within [min, max]
+int parseNumber(const char *str, size_t min, size_t max, size_t *output)
+{
+  if (!isdigit((unsigned char) str[0]))
+    return 0;
+  char *next;
+  errno = 0;
+  unsigned long long value = strtoull(str, &next, 10);
+  if (*next || errno == ERANGE || value < min || value > max)
+    return 0;
+  *output = value;
+  return 1;
+}
+
+// Sets the target of extra from its value, 0 if the value is invalid
+int parseExtra(const RunOptions::Extra& extra, const char *value)
+{
+  if (extra.number)
+    return parseNumber(value, extra.min, extra.max, extra.number);
+
+  if (extra.list)
+  {
+    std::vector<size_t> result;
+    std::string list(value);
+    size_t pos = 0;
+    while (pos <= list.size())
+    {
+      size_t end = list.find(',', pos);
+      if (end == std::string::npos)
+        end = list.size();
+      size_t n;
+      if (!parseNumber(list.substr(pos, end - pos).c_str(), extra.min, extra.max, &n))
+        return 0;
+      result.push_back(n);
+      pos = end + 1;
+    }
+    *extra.list = result;
+    return 1;
+  }
+
+  // One of the choices separated by '|'
+  std::string choices = "|" + extra.choices + "|";
+  if (strchr(value, '|') || choices.find("|" + std::string(value) + "|") == std::string::npos)
+    return 0;
+  *extra.text = value;
+  return 1;
+}
+
+// Parses a list of sizes: "1024", "256,512,1000" or "64:4096" for the
+// powers of two from 64 to 4096, which can be mixed ("100,64:256")
+int parseSizes(const char *str, std::vector<size_t> *sizes)
+{
+  std::vector<size_t> result;
+  std::string list(str);
+  size_t pos = 0;
+  while (pos <= list.size())
+  {
+    size_t end = list.find(',', pos);
+    if (end == std::string::npos)
+      end = list.size();
+    std::string item = list.substr(pos, end - pos);
+    size_t colon = item.find(':');
+
+    char *next;
+    size_t lo = strtoull(item.c_str(), &next, 10);
+    if (colon == std::string::npos)
+    {
+      if (item.empty() || *next || lo == 0)
+        return 0;
+      result.push_back(lo);
+    }
+    else
+    {
+      size_t hi = strtoull(item.c_str() + colon + 1, &next, 10);
+      if (lo == 0 || *next || hi < lo || item[0] == ':')
+        return 0;
+      // Stops before n * 2 could overflow
+      for (size_t n = lo; ; n *= 2)
+      {
+        result.push_back(n);
+        if (n > hi / 2)
+          break;
+      }
+    }
+    pos = end + 1;
+  }
+  *sizes = result;
+  return !result.empty();
+}
+
+void parseArguments(int argc, char *argv[], cl_uint *deviceIndex, RunOptions *options)
 {
   for (int i = 1; i < argc; i++)
   {
@@ -96,6 +264,56 @@ void parseArguments(int argc, char *argv[], cl_uint *deviceIndex)
         exit(1);
       }
     }
+    else if (options && !strcmp(argv[i], "--size"))
+    {
+      if (++i >= argc || !parseSizes(argv[i], &options->sizes))
+      {
+        std::cout << "Invalid size list\n";
+        exit(1);
+      }
+      options->sizeGiven = true;
+    }
+    else if (options && (!strcmp(argv[i], "--iterations") || !strcmp(argv[i], "--warmup")))
+    {
+      cl_uint value;
+      const char *option = argv[i];
+      if (++i >= argc || !parseUInt(argv[i], &value))
+      {
+        std::cout << "Invalid " << option << " count\n";
+        exit(1);
+      }
+      if (!strcmp(option, "--warmup"))
+        options->warmup = value;
+      else
+        options->iterations = value > 0 ? value : 1;
+    }
+    else if (options && (!strcmp(argv[i], "--variant") || !strcmp(argv[i], "--output")))
+    {
+      const char *option = argv[i];
+      if (++i >= argc)
+      {
+        std::cout << "Missing value for " << option << "\n";
+        exit(1);
+      }
+      if (!strcmp(option, "--variant"))
+        options->variant = argv[i];
+      else
+        options->output = argv[i];
+    }
+    else if (options && options->findExtra(argv[i]))
+    {
+      const RunOptions::Extra& extra = *options->findExtra(argv[i]);
+      if (extra.flag)
+        *extra.flag = true;
+      else if (++i >= argc || !parseExtra(extra, argv[i]))
+      {
+        std::cout << "Invalid value for " << extra.name;
+        if (!extra.choices.empty())
+          std::cout << " (" << extra.choices << ")";
+        std::cout << "\n";
+        exit(1);
+      }
+    }
     else if (!strcmp(argv[i], "--help") || !strcmp(argv[i], "-h"))
     {
       std::cout << "\n";
@@ -104,9 +322,30 @@ void parseArguments(int argc, char *argv[], cl_uint *deviceIndex)
       std::cout << "  -h  --help               Print the message\n";
       std::cout << "      --list               List available devices\n";
       std::cout << "      --device     INDEX   Select device at INDEX\n";
+      if (options)
+      {
+        std::cout << "      --size       LIST    Problem sizes, e.g. 1024 or 256,512 or 64:4096 (powers of 2)\n";
+        std::cout << "      --iterations N       Timed runs of each variant\n";
+        std::cout << "      --warmup     N       Untimed runs before them\n";
+        std::cout << "      --variant    NAME    Variant to run\n";
+        std::cout << "      --output     FILE    Write the results as CSV (or JSON for *.json)\n";
+        for (size_t e = 0; e < options->extras.size(); e++)
+        {
+          const RunOptions::Extra& extra = options->extras[e];
+          std::string name = extra.name, arg = extra.arg;
+          name.resize(std::max(name.size() + 1, (size_t) 13), ' ');
+          arg.resize(std::max(arg.size() + 1, (size_t) 8), ' ');
+          std::cout << "      " << name << arg << extra.help << "\n";
+        }
+      }
       std::cout << "\n";
       exit(0);
     }
   }
 }
 
+void parseArguments(int argc, char *argv[], cl_uint *deviceIndex)
+{
+  parseArguments(argc, argv, deviceIndex, NULL);
+}
+
@@ -0,0 +1,331 @@
+/*--------------------------------------------------------------------
+ **
+ ** Name:    elementwise.hpp
+ **
+ ** Purpose: Fused elementwise expressions on float device vectors.
+ **          An expression such as A + B + E + G only records its
+ **          tree; ElementwiseEngine::evaluate then generates a single
+ **          OpenCL kernel computing every requested output from one
+ **          read of each input, with no intermediate vector written
+ **          unless it is asked for. Common subexpressions are computed
+ **          once, and the kernels are cached by their source, which
+ **          only depends on the shape of the expressions.
+ **
+ ** Usage:   util::DeviceVector A(d_a, n), B(d_b, n), C(d_c, n), ...;
+ **          util::ElementwiseEngine engine(context, device, queue);
+ **          engine.evaluate(util::store(F, A + B + E + G));
+ **          // also materialise c = a + b, computed once
+ **          engine.evaluate(util::store(F, A + B + E + G),
+ **                          util::store(C, A + B));
+ **
+ ** Note:    Must be included AFTER the relevant OpenCL header
+ **
+ **--------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <map>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "program_cache.hpp"
+
+namespace util {
+
+  class ElementwiseBuilder;
+
+  //! A float vector in device memory, the leaf of the expressions
+  struct DeviceVector
+  {
+    cl::Buffer buffer;
+    size_t     size;
+
+    DeviceVector() : size(0) {}
+    DeviceVector(const cl::Buffer& buffer_, size_t size_) : buffer(buffer_), size(size_) {}
+
+    std::string emit(ElementwiseBuilder& builder) const;
+  };
+
+  //! A float constant, passed to the kernel as an argument
+  struct Scalar
+  {
+    float value;
+
+    explicit Scalar(float value_) : value(value_) {}
+
+    std::string emit(ElementwiseBuilder& builder) const;
+  };
+
+  //! l op r, for op one of + - * /
+  template <typename L, typename R>
+  struct BinaryExpr
+  {
+    char op;
+    L    l;
+    R    r;
+
+    BinaryExpr(char op_, const L& l_, const R& r_) : op(op_), l(l_), r(r_) {}
+
+    std::string emit(ElementwiseBuilder& builder) const;
+  };
+
+  template <typename T> struct IsExpr : std::false_type {};
+  template <> struct IsExpr<DeviceVector> : std::true_type {};
+  template <> struct IsExpr<Scalar> : std::true_type {};
+  template <typename L, typename R> struct IsExpr<BinaryExpr<L, R> > : std::true_type {};
+
+  //! Request to write the value of expr to target
+  template <typename E>
+  struct Store
+  {
+    DeviceVector target;
+    E            expr;
+  };
+
+  template <typename E>
+  Store<E> store(const DeviceVector& target, const E& expr)
+  {
+    Store<E> s = { target, expr };
+    return s;
+  }
+
+  /*!
+   * \brief Source of a fused kernel. Each input is read once into a
+   * register, each distinct operation is computed once, and only the
+   * stored values are written.
+   */
+  class ElementwiseBuilder
+  {
+    public:
+      ElementwiseBuilder() : size_(0), temporaries_(0) {}
+
+      //! Register holding v[i]
+      std::string input(const DeviceVector& v)
+      {
+        checkSize(v);
+        for (size_t k = 0; k < inputs_.size(); k++)
+          if (inputs_[k]() == v.buffer())
+            return name("x", k);
+
+        inputs_.push_back(v.buffer);
+        std::string x = name("x", inputs_.size() - 1);
+        body_ << "  float " << x << " = " << name("in", inputs_.size() - 1) << "[i];\n";
+        return x;
+      }
+
+      //! Kernel argument holding value
+      std::string scalar(float value)
+      {
+        scalars_.push_back(value);
+        return name("s", scalars_.size() - 1);
+      }
+
+      //! Register holding l op r
+      std::string binary(char op, const std::string& l, const std::string& r)
+      {
+        std::string expr = l + " " + op + " " + r;
+        std::map<std::string, std::string>::iterator it = values_.find(expr);
+        if (it != values_.end())
+          return it->second;
+
+        std::string t = name("t", temporaries_++);
+        body_ << "  float " << t << " = " << expr << ";\n";
+        return values_[expr] = t;
+      }
+
+      //! Writes value to target[i]
+      void output(const DeviceVector& target, const std::string& value)
+      {
+        checkSize(target);
+        outputs_.push_back(target.buffer);
+        body_ << "  " << name("out", outputs_.size() - 1) << "[i] = " << value << ";\n";
+      }
+
+      //! Kernel source, the same for expressions of the same shape
+      std::string source() const
+      {
+        std::ostringstream src;
+        src << "__kernel void fused(const unsigned int count";
+        for (size_t k = 0; k < inputs_.size(); k++)
+          src << ",\n    __global const float* " << name("in", k);
+        for (size_t k = 0; k < outputs_.size(); k++)
+          src << ",\n    __global float* " << name("out", k);
+        for (size_t k = 0; k < scalars_.size(); k++)
+          src << ",\n    const float " << name("s", k);
+        src << ")\n{\n"
+            << "  int i = get_global_id(0);\n"
+            << "  if (i >= count)\n"
+            << "    return;\n"
+            << body_.str()
+            << "}\n";
+        return src.str();
+      }
+
+      //! Arguments of the kernel, in the order of source()
+      void setArgs(cl::Kernel& kernel) const
+      {
+        cl_uint arg = 0;
+        kernel.setArg(arg++, (cl_uint) size_);
+        for (size_t k = 0; k < inputs_.size(); k++)
+          kernel.setArg(arg++, inputs_[k]);
+        for (size_t k = 0; k < outputs_.size(); k++)
+          kernel.setArg(arg++, outputs_[k]);
+        for (size_t k = 0; k < scalars_.size(); k++)
+          kernel.setArg(arg++, scalars_[k]);
+      }
+
+      size_t size() const { return size_; }
+
+    private:
+      static std::string name(const char* prefix, size_t k)
+      {
+        std::ostringstream s;
+        s << prefix << k;
+        return s.str();
+      }
+
+      void checkSize(const DeviceVector& v)
+      {
+        if (size_ == 0)
+          size_ = v.size;
+        else if (v.size != size_)
+          throw cl::Error(CL_INVALID_VALUE, "util::ElementwiseBuilder: vectors of different sizes");
+      }
+
+      size_t                              size_;
+      size_t                              temporaries_;
+      std::vector<cl::Buffer>             inputs_;
+      std::vector<cl::Buffer>             outputs_;
+      std::vector<float>                  scalars_;
+      std::map<std::string, std::string>  values_;  // operation -> register
+      std::ostringstream                  body_;
+  };
+
+  inline std::string DeviceVector::emit(ElementwiseBuilder& builder) const
+  {
+    return builder.input(*this);
+  }
+
+  inline std::string Scalar::emit(ElementwiseBuilder& builder) const
+  {
+    return builder.scalar(value);
+  }
+
+  template <typename L, typename R>
+  std::string BinaryExpr<L, R>::emit(ElementwiseBuilder& builder) const
+  {
+    std::string lv = l.emit(builder);
+    std::string rv = r.emit(builder);
+    return builder.binary(op, lv, rv);
+  }
+
+  // expr op expr, float op expr and expr op float
+#define ELEMENTWISE_OPERATOR(OP)                                              \
+  template <typename L, typename R>                                          \
+  typename std::enable_if<IsExpr<L>::value && IsExpr<R>::value,              \
+                          BinaryExpr<L, R> >::type                           \
+  operator OP(const L& l, const R& r)                                        \
+  {                                                                          \
+    return BinaryExpr<L, R>(#OP[0], l, r);                                   \
+  }                                                                          \
+  template <typename R>                                                      \
+  typename std::enable_if<IsExpr<R>::value, BinaryExpr<Scalar, R> >::type    \
+  operator OP(float l, const R& r)                                           \
+  {                                                                          \
+    return BinaryExpr<Scalar, R>(#OP[0], Scalar(l), r);                      \
+  }                                                                          \
+  template <typename L>                                                      \
+  typename std::enable_if<IsExpr<L>::value, BinaryExpr<L, Scalar> >::type    \
+  operator OP(const L& l, float r)                                           \
+  {                                                                          \
+    return BinaryExpr<L, Scalar>(#OP[0], l, Scalar(r));                      \
+  }
+
+  ELEMENTWISE_OPERATOR(+)
+  ELEMENTWISE_OPERATOR(-)
+  ELEMENTWISE_OPERATOR(*)
+  ELEMENTWISE_OPERATOR(/)
+
+#undef ELEMENTWISE_OPERATOR
+
+  /*!
+   * \brief Builds and runs fused kernels on one queue. The kernels are
+   * kept by source, so evaluating an expression of the same shape
+   * again (even on other vectors or constants) builds nothing.
+   */
+  class ElementwiseEngine
+  {
+    public:
+      ElementwiseEngine(const cl::Context& context, const cl::Device& device,
+                        const cl::CommandQueue& queue)
+        : context_(context), device_(device), queue_(queue)
+      {
+      }
+
+      //! Computes every store in one kernel launch, returns its event
+      template <typename... S>
+      cl::Event evaluate(const S&... stores)
+      {
+        return enqueue(queue_, stores...);
+      }
+
+      //! Same as evaluate, on another queue of the context
+      template <typename... S>
+      cl::Event enqueue(cl::CommandQueue& queue, const S&... stores)
+      {
+        ElementwiseBuilder builder;
+        add(builder, stores...);
+
+        cl::Kernel& kernel = this->kernel(builder.source());
+        builder.setArgs(kernel);
+
+        cl::Event event;
+        queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(builder.size()),
+                                   cl::NullRange, NULL, &event);
+        return event;
+      }
+
+      //! Source of the kernel evaluate would run, for inspection
+      template <typename... S>
+      std::string source(const S&... stores) const
+      {
+        ElementwiseBuilder builder;
+        add(builder, stores...);
+        return builder.source();
+      }
+
+      //! Number of distinct kernels built so far
+      size_t kernelCount() const { return kernels_.size(); }
+
+    private:
+      static void add(ElementwiseBuilder&)
+      {
+      }
+
+      template <typename E, typename... S>
+      static void add(ElementwiseBuilder& builder, const Store<E>& first, const S&... rest)
+      {
+        builder.output(first.target, first.expr.emit(builder));
+        add(builder, rest...);
+      }
+
+      cl::Kernel& kernel(const std::string& source)
+      {
+        std::map<std::string, cl::Kernel>::iterator it = kernels_.find(source);
+        if (it != kernels_.end())
+          return it->second;
+
+        cl::Program program = buildProgram(context_, device_, source);
+        return kernels_[source] = cl::Kernel(program, "fused");
+      }
+
+      cl::Context                        context_;
+      cl::Device                         device_;
+      cl::CommandQueue                   queue_;
+      std::map<std::string, cl::Kernel>  kernels_;
+  };
+
+} // namespace util
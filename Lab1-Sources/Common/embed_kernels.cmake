@@ -0,0 +1,31 @@
+# Turns an OpenCL source file into a C++ file holding its text as a byte
+# array, registered under its file name for util::loadProgram.
+#
+# Usage: cmake -DINPUT=<file.cl> -DOUTPUT=<file.cpp> -DNAME=<name> -P embed_kernels.cmake
+
+file(READ "${INPUT}" hex HEX)
+
+# Un octet "ab" devient "0xab,", 16 octets par ligne (les expressions
+# régulières de CMake n'ont pas de répétition {n})
+string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," bytes "${hex}")
+set(line "")
+foreach(i RANGE 15)
+  set(line "${line}0x[0-9a-f][0-9a-f],")
+endforeach()
+string(REGEX REPLACE "(${line})" "\\1\n    " bytes "${bytes}")
+
+file(WRITE "${OUTPUT}"
+"// Generated from ${NAME} by embed_kernels.cmake, do not edit
+
+#include \"embedded_kernels.hpp\"
+
+namespace {
+
+constexpr unsigned char source[] = {
+    ${bytes}0x00
+};
+
+const util::EmbeddedKernel kernel(\"${NAME}\", reinterpret_cast<const char*>(source), sizeof(source) - 1);
+
+}
+")
@@ -0,0 +1,52 @@
+/*--------------------------------------------------------------------
+ **
+ ** Name:    embedded_kernels.hpp
+ **
+ ** Purpose: Registry of the OpenCL sources compiled into the
+ **          executable by embed_opencl_kernels (see CMakeLists.txt).
+ **          Each generated file registers its kernel under the name
+ **          of the .cl file; util::loadProgram looks here before
+ **          reading from disk.
+ **
+ **--------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <string>
+
+namespace util {
+
+  struct EmbeddedSource
+  {
+    const char* data;
+    size_t      size;
+  };
+
+  //! All the embedded sources, by file name
+  inline std::map<std::string, EmbeddedSource>& embeddedKernels()
+  {
+    static std::map<std::string, EmbeddedSource> kernels;
+    return kernels;
+  }
+
+  //! Registers a source at static initialisation time
+  struct EmbeddedKernel
+  {
+    EmbeddedKernel(const char* name, const char* data, size_t size)
+    {
+      EmbeddedSource source = { data, size };
+      embeddedKernels()[name] = source;
+    }
+  };
+
+  //! Embedded source called name, NULL if there is none
+  inline const EmbeddedSource* findEmbeddedKernel(const std::string& name)
+  {
+    std::map<std::string, EmbeddedSource>::const_iterator it = embeddedKernels().find(name);
+    return it == embeddedKernels().end() ? NULL : &it->second;
+  }
+
+} // namespace util
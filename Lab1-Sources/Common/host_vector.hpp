@@ -0,0 +1,160 @@
+/*--------------------------------------------------------------------
+ **
+ ** Name:    host_vector.hpp
+ **
+ ** Purpose: Float vector shared by the host and a device, accessed
+ **          from the host through map()/unmap() whatever the memory
+ **          behind it:
+ **
+ **          COPY            host array and device buffer, copied by
+ **                          map (for reading) and unmap (after writing)
+ **          USE_HOST_PTR    page aligned host array used as the buffer
+ **                          storage (CL_MEM_USE_HOST_PTR): no copy on
+ **                          devices sharing the host memory
+ **          ALLOC_HOST_PTR  storage allocated by the runtime in host
+ **                          memory (CL_MEM_ALLOC_HOST_PTR), pinned for
+ **                          faster transfers on discrete devices
+ **
+ **          preferredMode() picks USE_HOST_PTR on the devices which
+ **          report CL_DEVICE_HOST_UNIFIED_MEMORY (CPUs, integrated
+ **          GPUs), COPY otherwise.
+ **
+ ** Usage:   util::HostVector a(context, n, util::preferredMode(device));
+ **          float* p = a.map(queue, CL_MAP_WRITE); ... a.unmap(queue);
+ **          kernel(..., a.buffer(), ...);
+ **          const float* r = a.map(queue, CL_MAP_READ); ... a.unmap(queue);
+ **
+ ** Note:    Must be included AFTER the relevant OpenCL header
+ **
+ **--------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <cstdlib>
+#include <string>
+
+namespace util {
+
+  //! Alignment of the host arrays and of the buffer sizes: a page, which
+  //! is what zero copy implementations require
+  const size_t HOST_VECTOR_ALIGNMENT = 4096;
+
+  class HostVector
+  {
+    public:
+      enum Mode { COPY, USE_HOST_PTR, ALLOC_HOST_PTR };
+
+      HostVector(const cl::Context& context, size_t size, Mode mode,
+                 cl_mem_flags access = CL_MEM_READ_WRITE)
+        : size_(size), capacity_(0), mode_(mode), host_(NULL), mapped_(NULL), mapFlags_(0)
+      {
+        // Whole pages for the host array and the buffer alike: zero copy
+        // needs the size, not only the address, to be aligned. size_
+        // keeps the logical size, which is all that map() transfers.
+        size_t bytes = sizeof(float) * (size > 0 ? size : 1);
+        capacity_ = (bytes + HOST_VECTOR_ALIGNMENT - 1) / HOST_VECTOR_ALIGNMENT * HOST_VECTOR_ALIGNMENT;
+        if (mode != ALLOC_HOST_PTR) {
+          void* p = NULL;
+          if (posix_memalign(&p, HOST_VECTOR_ALIGNMENT, capacity_) != 0)
+            throw cl::Error(CL_OUT_OF_HOST_MEMORY, "util::HostVector");
+          host_ = static_cast<float*>(p);
+        }
+
+        if (mode == USE_HOST_PTR)
+          buffer_ = cl::Buffer(context, access | CL_MEM_USE_HOST_PTR, capacity_, host_);
+        else if (mode == ALLOC_HOST_PTR)
+          buffer_ = cl::Buffer(context, access | CL_MEM_ALLOC_HOST_PTR, capacity_);
+        else
+          buffer_ = cl::Buffer(context, access, capacity_);
+      }
+
+      ~HostVector()
+      {
+        // The buffer may use the host array: release it first
+        buffer_ = cl::Buffer();
+        free(host_);
+      }
+
+      /*!
+       * \brief Host view of the vector, valid until unmap. flags are
+       * CL_MAP_READ and/or CL_MAP_WRITE: reading waits for the device
+       * data, writing makes unmap publish the changes to the device.
+       */
+      float* map(cl::CommandQueue& queue, cl_map_flags flags)
+      {
+        size_t bytes = sizeof(float) * size_;
+        mapFlags_ = flags;
+        if (mode_ == COPY) {
+          if ((flags & CL_MAP_READ) && bytes > 0)
+            queue.enqueueReadBuffer(buffer_, CL_TRUE, 0, bytes, host_);
+          mapped_ = host_;
+        }
+        else {
+          mapped_ = static_cast<float*>(queue.enqueueMapBuffer(buffer_, CL_TRUE, flags, 0, bytes));
+        }
+        return mapped_;
+      }
+
+      //! Ends the host access started by map
+      void unmap(cl::CommandQueue& queue)
+      {
+        if (!mapped_)
+          return;
+        if (mode_ == COPY) {
+          if ((mapFlags_ & CL_MAP_WRITE) && size_ > 0)
+            queue.enqueueWriteBuffer(buffer_, CL_TRUE, 0, sizeof(float) * size_, host_);
+        }
+        else {
+          cl::Event event;
+          queue.enqueueUnmapMemObject(buffer_, mapped_, NULL, &event);
+          event.wait();
+        }
+        mapped_ = NULL;
+      }
+
+      const cl::Buffer& buffer() const { return buffer_; }
+      size_t size() const { return size_; }
+      //! Bytes of the buffer, the size rounded up to HOST_VECTOR_ALIGNMENT
+      size_t capacity() const { return capacity_; }
+      Mode mode() const { return mode_; }
+
+      static const char* modeName(Mode mode)
+      {
+        return mode == USE_HOST_PTR ? "use_host_ptr" : mode == ALLOC_HOST_PTR ? "alloc_host_ptr" : "copy";
+      }
+
+    private:
+      HostVector(const HostVector&);
+      HostVector& operator=(const HostVector&);
+
+      size_t        size_;
+      size_t        capacity_;  // in bytes
+      Mode          mode_;
+      float*        host_;      // NULL for ALLOC_HOST_PTR
+      float*        mapped_;    // current host view, NULL when unmapped
+      cl_map_flags  mapFlags_;
+      cl::Buffer    buffer_;
+  };
+
+  //! Zero copy on devices sharing the host memory, copies otherwise
+  inline HostVector::Mode preferredMode(const cl::Device& device)
+  {
+    return device.getInfo<CL_DEVICE_HOST_UNIFIED_MEMORY>() ? HostVector::USE_HOST_PTR
+                                                           : HostVector::COPY;
+  }
+
+  //! Mode from its name ("copy", "use_host_ptr", "alloc_host_ptr"), or
+  //! preferredMode for "auto"
+  inline HostVector::Mode parseMode(const std::string& name, const cl::Device& device)
+  {
+    if (name == "copy")
+      return HostVector::COPY;
+    if (name == "use_host_ptr")
+      return HostVector::USE_HOST_PTR;
+    if (name == "alloc_host_ptr")
+      return HostVector::ALLOC_HOST_PTR;
+    return preferredMode(device);
+  }
+
+} // namespace util
@@ -0,0 +1,74 @@
+/* ----------------------------------------------------------------
+ **
+ ** kernel:  integrate
+ **
+ ** Purpose: Integrate INTEGRAND(x) from a with the midpoint rule, the
+ **          integrand being defined by a line the host puts before
+ **          this source, e.g. #define INTEGRAND(x) (4.0/(1.0+x*x))
+ **          (see integrate.hpp)
+ **
+ ** input:   niters steps per work-item, the chunk of num_steps steps
+ **          starting at a, h the width of a step, local_sums a __local
+ **          buffer of one value per work-item of the group
+ **
+ ** output:  partial_sums, one sum per work-group, to be added up and
+ **          multiplied by h by the host
+ **
+ ** ----------------------------------------------------------------
+ */
+
+// Calcul en double si l'hôte l'a demandé (-DUSE_DOUBLE), le périphérique
+// supportant alors cl_khr_fp64
+#ifdef USE_DOUBLE
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+typedef double real;
+#else
+typedef float real;
+#endif
+
+#ifndef INTEGRAND
+#error "INTEGRAND(x) doit être défini par l'hôte avant ce source"
+#endif
+
+__kernel void integrate(
+    const int niters,
+    const int num_steps,
+    const real a,
+    const real h,
+    __local real* local_sums,
+    __global real* partial_sums)
+{
+  int num_wrk_items = get_local_size(0);
+  int local_id      = get_local_id(0);
+  int group_id      = get_group_id(0);
+
+  // Chaque work-item intègre un bloc contigu de niters pas du morceau.
+  // Seul le décalage depuis le début du bloc passe en real : en float,
+  // un indice de pas au-delà de 2^24 ne serait plus exact
+  int istart = (group_id * num_wrk_items + local_id) * niters;
+  int iend   = min(istart + niters, num_steps);
+  real x0    = a + (real) istart * h;
+
+  real x, accum = 0;
+  for (int i = 0; i < iend - istart; i++)
+  {
+    x = x0 + ((real) i + (real) 0.5) * h;
+    accum += INTEGRAND(x);
+  }
+
+  // Réduction en arbre dans la mémoire locale (taille de groupe
+  // puissance de 2, imposée par l'hôte)
+  local_sums[local_id] = accum;
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for (int offset = num_wrk_items / 2; offset > 0; offset /= 2)
+  {
+    if (local_id < offset)
+      local_sums[local_id] += local_sums[local_id + offset];
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+
+  // Le premier work-item écrit la somme du groupe
+  if (local_id == 0)
+    partial_sums[group_id] = local_sums[0];
+}
@@ -0,0 +1,274 @@
+/*--------------------------------------------------------------------
+ **
+ ** Name:    integrate.hpp
+ **
+ ** Purpose: Midpoint rule quadrature of a function over [a, b]:
+ **
+ **              util::integrate<F>(a, b, steps, policy)
+ **
+ **          F is a functor type. Its operator()(double) is inlined in
+ **          the host loops, and its static member opencl() returns the
+ **          same function as an OpenCL C expression of x, which is
+ **          defined as INTEGRAND(x) before the source of integrate.cl
+ **          The policy picks where the sum runs:
+ **
+ **            util::Sequential    one loop on the host
+ **            util::Threaded(n)   n threads summing vectorised blocks,
+ **                                with a result independent of n
+ **            util::OpenCLDevice  integrate.cl on a device, in chunks
+ **
+ ** Usage:   struct Pi {
+ **            double operator()(double x) const { return 4.0/(1.0+x*x); }
+ **            static const char* opencl() { return "4.0/(1.0+x*x)"; }
+ **          };
+ **          double pi = util::integrate<Pi>(0.0, 1.0, steps, util::Threaded(4));
+ **
+ ** Note:    Must be included AFTER the relevant OpenCL header. The
+ **          executables using OpenCLDevice embed Common/integrate.cl.
+ **
+ **--------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "util.hpp"
+#include "program_cache.hpp"
+#include "profiling.hpp"
+
+namespace util {
+
+  //! One loop on the host, in the order of the steps
+  struct Sequential
+  {
+  };
+
+  //! Threads on the host (0: one per hardware thread)
+  struct Threaded
+  {
+    int threads;
+
+    explicit Threaded(int threads_ = 0) : threads(threads_) {}
+  };
+
+  //! Steps per block of the threaded sum, and blocks per pass of the threads
+  const long long INTEGRATE_BLOCK  = 65536;
+  const long long INTEGRATE_CHUNK  = 4096;
+  //! Independent partial sums in a block (SIMD lanes)
+  const int       INTEGRATE_LANES  = 8;
+
+  /*!
+   * \brief Sum of f over the midpoints of the steps [first, last), in
+   * INTEGRATE_LANES partial sums which the compiler can keep in vector
+   * registers. The order of the additions only depends on first and
+   * last. Kept out of line: once inlined in a thread lambda, GCC no
+   * longer vectorises the lanes.
+   */
+  template <typename F>
+#if defined(__GNUC__)
+  __attribute__((noinline))
+#endif
+  double integrateBlock(double a, double h, long long first, long long last)
+  {
+    F f;
+    double acc[INTEGRATE_LANES] = { 0.0 };
+    double offset[INTEGRATE_LANES];   // l + 0.5, so that base + offset[l] is exact
+    for (int l = 0; l < INTEGRATE_LANES; l++)
+      offset[l] = l + 0.5;
+
+    long long i = first;
+    for (; i + INTEGRATE_LANES <= last; i += INTEGRATE_LANES) {
+      double base = (double) i;
+      for (int l = 0; l < INTEGRATE_LANES; l++)
+        acc[l] += f(a + (base + offset[l]) * h);
+    }
+    for (; i < last; i++)
+      acc[0] += f(a + (i + 0.5) * h);
+
+    double sum = 0.0;
+    for (int l = 0; l < INTEGRATE_LANES; l++)
+      sum += acc[l];
+    return sum;
+  }
+
+  //! Sequential midpoint rule
+  template <typename F>
+  double integrate(double a, double b, long long steps, const Sequential&)
+  {
+    F f;
+    double h = (b - a) / steps;
+    double sum = 0.0;
+    for (long long i = 0; i < steps; i++)
+      sum += f(a + (i + 0.5) * h);
+    return h * sum;
+  }
+
+  /*!
+   * \brief Threaded midpoint rule. The steps are cut in blocks of
+   * INTEGRATE_BLOCK steps, each thread sums a contiguous range of
+   * blocks, and the block sums are added in block order, so the result
+   * is the same for any number of threads. The blocks go through in
+   * passes of INTEGRATE_CHUNK, which bounds the memory used.
+   */
+  template <typename F>
+  double integrate(double a, double b, long long steps, const Threaded& policy)
+  {
+    int nthreads = policy.threads > 0 ? policy.threads
+                                      : std::max(1u, std::thread::hardware_concurrency());
+    double h = (b - a) / steps;
+    long long nblocks = (steps + INTEGRATE_BLOCK - 1) / INTEGRATE_BLOCK;
+    std::vector<double> block_sums(std::min(nblocks, INTEGRATE_CHUNK));
+    double sum = 0.0;
+
+    for (long long first = 0; first < nblocks; first += INTEGRATE_CHUNK) {
+      long long n = std::min(nblocks - first, INTEGRATE_CHUNK);
+
+      std::vector<std::thread> threads;
+      for (int t = 0; t < nthreads; t++)
+        threads.push_back(std::thread([&, t]() {
+          for (long long block = n * t / nthreads; block < n * (t + 1) / nthreads; block++)
+            block_sums[block] = integrateBlock<F>(a, h, (first + block) * INTEGRATE_BLOCK,
+                                                  std::min(steps, (first + block + 1) * INTEGRATE_BLOCK));
+        }));
+      for (size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+
+      for (long long block = 0; block < n; block++)
+        sum += block_sums[block];
+    }
+    return h * sum;
+  }
+
+  /*!
+   * \brief Midpoint rule with the kernel of integrate.cl, built once per
+   * integrand (and cached on disk by buildProgram). The sum runs in
+   * double when the device supports it, in float otherwise. The steps
+   * go through in launches of at most chunkSteps, which bounds the
+   * NDRange and the time of each launch.
+   */
+  class OpenCLDevice
+  {
+    public:
+      OpenCLDevice(const cl::Context& context, const cl::Device& device,
+                   const cl::CommandQueue& queue)
+        : context_(context), device_(device), queue_(queue),
+          niters_(4096), workGroupSize_(64), chunkSteps_(1 << 28), deviceTime_(0.0)
+      {
+        fp64_ = device.getInfo<CL_DEVICE_DOUBLE_FP_CONFIG>() != 0;
+        profiling_ = (queue.getInfo<CL_QUEUE_PROPERTIES>() & CL_QUEUE_PROFILING_ENABLE) != 0;
+      }
+
+      //! Integral over [a, b] of an OpenCL C expression of x
+      double integrate(const std::string& expression, double a, double b, long long steps)
+      {
+        cl::Kernel kernel(program(expression), "integrate");
+        size_t real_size = fp64_ ? sizeof(double) : sizeof(float);
+        double h = (b - a) / steps;
+
+        // Power of 2 work-groups, as needed by the reduction of the kernel
+        size_t max_size = kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device_);
+        size_t work_group_size = 1;
+        while (work_group_size * 2 <= workGroupSize_ && work_group_size * 2 <= max_size)
+          work_group_size *= 2;
+
+        long long chunk_steps = std::min(steps, chunkSteps_);
+        size_t nwork_items = (chunk_steps + niters_ - 1) / niters_;
+        size_t nwork_groups = (nwork_items + work_group_size - 1) / work_group_size;
+
+        cl::Buffer d_partial_sums(context_, CL_MEM_WRITE_ONLY, real_size * nwork_groups);
+
+        kernel.setArg(0, niters_);
+        if (fp64_)
+          kernel.setArg(3, h);
+        else
+          kernel.setArg(3, (float) h);
+        kernel.setArg(4, cl::Local(real_size * work_group_size));
+        kernel.setArg(5, d_partial_sums);
+
+        double sum = 0.0;
+        deviceTime_ = 0.0;
+        for (long long first = 0; first < steps; first += chunk_steps) {
+          // The start of the chunk, in double on the host: the kernel only
+          // converts step offsets within the chunk
+          double start = a + first * h;
+          kernel.setArg(1, (int) std::min(chunk_steps, steps - first));
+          if (fp64_)
+            kernel.setArg(2, start);
+          else
+            kernel.setArg(2, (float) start);
+
+          cl::Event event;
+          queue_.enqueueNDRangeKernel(kernel, cl::NullRange,
+                                      cl::NDRange(nwork_groups * work_group_size),
+                                      cl::NDRange(work_group_size), NULL, &event);
+
+          sum += fp64_ ? sumPartials<double>(d_partial_sums, nwork_groups)
+                       : sumPartials<float>(d_partial_sums, nwork_groups);
+          if (profiling_)
+            deviceTime_ += getEventTimes(event).execution();
+        }
+        return h * sum;
+      }
+
+      //! Kernel time of the last integrate, in seconds (0 without a profiling queue)
+      double deviceTime() const { return deviceTime_; }
+
+      //! Whether the sums run in double
+      bool doublePrecision() const { return fp64_; }
+
+    private:
+      //! Program of integrate.cl for the integrand expression
+      const cl::Program& program(const std::string& expression)
+      {
+        std::map<std::string, cl::Program>::iterator it = programs_.find(expression);
+        if (it != programs_.end())
+          return it->second;
+
+        // The expression goes in a #define before the source rather than
+        // in a -D option, which the compiler would split on blanks
+        std::string source = "#define INTEGRAND(x) (" + expression + ")\n" +
+                             loadProgram("integrate.cl");
+        std::string options = fp64_ ? "-DUSE_DOUBLE" : "-cl-single-precision-constant";
+
+        cl::Program program = buildProgram(context_, device_, source, options);
+        return programs_[expression] = program;
+      }
+
+      //! Adds up the sums of the work-groups, always in the same order
+      template <typename real>
+      double sumPartials(const cl::Buffer& d_partial_sums, size_t ngroups)
+      {
+        std::vector<real> h_partial_sums(ngroups);
+        cl::copy(queue_, d_partial_sums, h_partial_sums.begin(), h_partial_sums.end());
+
+        double sum = 0.0;
+        for (size_t g = 0; g < ngroups; g++)
+          sum += h_partial_sums[g];
+        return sum;
+      }
+
+      cl::Context                         context_;
+      cl::Device                          device_;
+      cl::CommandQueue                    queue_;
+      int                                 niters_;         // steps per work-item
+      size_t                              workGroupSize_;  // lowered to the device limit
+      long long                           chunkSteps_;     // steps per launch
+      bool                                fp64_;
+      bool                                profiling_;
+      double                              deviceTime_;
+      std::map<std::string, cl::Program>  programs_;
+  };
+
+  //! Midpoint rule on an OpenCL device, with the expression F::opencl()
+  template <typename F>
+  double integrate(double a, double b, long long steps, OpenCLDevice& policy)
+  {
+    return policy.integrate(F::opencl(), a, b, steps);
+  }
+
+} // namespace util
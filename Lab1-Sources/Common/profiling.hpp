@@ -0,0 +1,80 @@
+/*--------------------------------------------------------------------
+ **
+ ** Name:    profiling.hpp
+ **
+ ** Purpose: Device side timing of OpenCL commands from their events
+ **          (CL_QUEUE_PROFILING_ENABLE), so that run times exclude
+ **          the host launch and queueing overheads.
+ **
+ ** Note:    Must be included AFTER the relevant OpenCL header
+ **
+ **--------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+namespace util {
+
+  //! The four time stamps of a command, in nanoseconds of the device clock
+  struct EventTimes
+  {
+    cl_ulong queued; // enqueued by the host
+    cl_ulong submit; // sent to the device
+    cl_ulong start;  // started executing
+    cl_ulong end;    // finished
+
+    //! Execution time on the device, in seconds
+    double execution() const { return (end - start) * 1e-9; }
+
+    //! Time between the enqueue and the start of execution, in seconds
+    double overhead() const { return (start - queued) * 1e-9; }
+
+    //! Time from enqueue to completion, in seconds
+    double total() const { return (end - queued) * 1e-9; }
+  };
+
+  //! Time stamps of a completed command. The queue it went through
+  //! must have been created with CL_QUEUE_PROFILING_ENABLE.
+  inline EventTimes getEventTimes(const cl::Event& event)
+  {
+    EventTimes t;
+    t.queued = event.getProfilingInfo<CL_PROFILING_COMMAND_QUEUED>();
+    t.submit = event.getProfilingInfo<CL_PROFILING_COMMAND_SUBMIT>();
+    t.start  = event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+    t.end    = event.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+    return t;
+  }
+
+  //! Times covering a sequence of commands, from the first enqueue to
+  //! the last completion
+  inline EventTimes getEventTimes(const cl::Event& first, const cl::Event& last)
+  {
+    EventTimes t = getEventTimes(first);
+    t.end = getEventTimes(last).end;
+    return t;
+  }
+
+  //! Prints the phases of a command, in milliseconds
+  inline void printEventTimes(const std::string& label, const EventTimes& t)
+  {
+    printf(" %s: queued->submit %.3f ms, submit->start %.3f ms, start->end %.3f ms\n",
+           label.c_str(),
+           (t.submit - t.queued) * 1e-6,
+           (t.start - t.submit) * 1e-6,
+           (t.end - t.start) * 1e-6);
+  }
+
+  //! In order queue on device, with profiling if requested
+  inline cl::CommandQueue makeQueue(const cl::Context& context,
+                                    const cl::Device& device,
+                                    bool profiling = true)
+  {
+    return cl::CommandQueue(context, device,
+                            profiling ? CL_QUEUE_PROFILING_ENABLE : 0);
+  }
+
+} // namespace util
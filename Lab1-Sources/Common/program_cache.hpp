@@ -0,0 +1,156 @@
+/*--------------------------------------------------------------------
+ **
+ ** Name:    program_cache.hpp
+ **
+ ** Purpose: Build OpenCL programs through an on-disk cache of
+ **          program binaries, so that a kernel is only compiled from
+ **          source the first time it is used on a given device.
+ **
+ **          Entries are keyed by device name, device and driver
+ **          versions, build options and a hash of the source. A
+ **          missing, stale or rejected binary falls back to a build
+ **          from source, which then refreshes the cache.
+ **
+ **          The cache lives in $OPENCL_CACHE_DIR, or else in
+ **          $HOME/.cache/labopencl. Setting OPENCL_CACHE_DIR to an
+ **          empty string disables it.
+ **
+ ** Note:    Must be included AFTER the relevant OpenCL header
+ **
+ **--------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace util {
+
+  //! 64 bit FNV-1a hash
+  inline unsigned long long hashString(const std::string& s)
+  {
+    unsigned long long h = 14695981039346656037ULL;
+    for (size_t i = 0; i < s.size(); i++) {
+      h ^= (unsigned char) s[i];
+      h *= 1099511628211ULL;
+    }
+    return h;
+  }
+
+  //! Directory of the program cache, empty if caching is disabled
+  inline std::string programCacheDir()
+  {
+    const char* dir = getenv("OPENCL_CACHE_DIR");
+    if (dir)
+      return dir;
+    const char* home = getenv("HOME");
+    if (!home || !*home)
+      return "";
+    return std::string(home) + "/.cache/labopencl";
+  }
+
+  //! mkdir -p
+  inline bool makeDirectories(const std::string& path)
+  {
+    for (size_t pos = 1; pos <= path.size(); pos++) {
+      if (pos == path.size() || path[pos] == '/') {
+        std::string dir = path.substr(0, pos);
+        if (mkdir(dir.c_str(), 0755) != 0) {
+          struct stat st;
+          if (stat(dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+            return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  //! Cache key of a program: everything that changes the binary
+  inline std::string programCacheKey(const cl::Device& device,
+                                     const std::string& source,
+                                     const std::string& options)
+  {
+    std::ostringstream key;
+    key << device.getInfo<CL_DEVICE_NAME>() << "|"
+        << device.getInfo<CL_DEVICE_VERSION>() << "|"
+        << device.getInfo<CL_DRIVER_VERSION>() << "|"
+        << options << "|"
+        << std::hex << hashString(source) << "|" << std::dec << source.size();
+    return key.str();
+  }
+
+  /*!
+   * \brief Builds source for device with options, going through the
+   * binary cache. Build errors of the source throw cl::Error as
+   * cl::Program::build does.
+   */
+  inline cl::Program buildProgram(const cl::Context& context,
+                                  const cl::Device& device,
+                                  const std::string& source,
+                                  const std::string& options = "")
+  {
+    std::vector<cl::Device> devices(1, device);
+    std::string dir = programCacheDir();
+    std::string key, path;
+
+    if (!dir.empty()) {
+      key = programCacheKey(device, source, options);
+      std::ostringstream name;
+      name << dir << "/" << std::hex << hashString(key) << ".bin";
+      path = name.str();
+
+      // File layout: the key on the first line, then the binary
+      std::ifstream in(path.c_str(), std::ios::binary);
+      std::string storedKey;
+      if (in && std::getline(in, storedKey) && storedKey == key) {
+        std::string binary((std::istreambuf_iterator<char>(in)),
+                           std::istreambuf_iterator<char>());
+        if (!binary.empty()) {
+          try {
+            cl::Program::Binaries binaries(1, std::make_pair(binary.data(), binary.size()));
+            cl::Program program(context, devices, binaries);
+            program.build(devices, options.c_str());
+            return program;
+          }
+          catch (cl::Error&) {
+            // Rejected by the driver: rebuild from source below
+          }
+        }
+      }
+    }
+
+    cl::Program program(context, source);
+    program.build(devices, options.c_str());
+
+    if (!path.empty() && makeDirectories(dir)) {
+      std::vector<char*> binaries = program.getInfo<CL_PROGRAM_BINARIES>();
+      std::vector<size_t> sizes = program.getInfo<CL_PROGRAM_BINARY_SIZES>();
+
+      if (!binaries.empty() && binaries[0] && sizes[0] > 0) {
+        // Write then rename, so concurrent runs never read half a file
+        std::ostringstream tmp;
+        tmp << path << "." << getpid() << ".tmp";
+        std::ofstream out(tmp.str().c_str(), std::ios::binary);
+        out << key << "\n";
+        out.write(binaries[0], sizes[0]);
+        out.close();
+        if (!out || std::rename(tmp.str().c_str(), path.c_str()) != 0)
+          std::remove(tmp.str().c_str());
+      }
+      for (size_t i = 0; i < binaries.size(); i++)
+        delete[] binaries[i];
+    }
+
+    return program;
+  }
+
+} // namespace util
@@ -0,0 +1,139 @@
+/*--------------------------------------------------------------------
+ **
+ ** Name:    streaming.hpp
+ **
+ ** Purpose: Elementwise operations on host arrays larger than the
+ **          device memory. The arrays go through in chunks, chunk i
+ **          on queue i % nqueues with its own set of device buffers,
+ **          so that with 2 or 3 queues the upload of a chunk, the
+ **          kernel of the previous one and the download of the one
+ **          before overlap (on devices with separate copy engines).
+ **          Each queue being in order, a set of buffers is only
+ **          rewritten once the previous chunk in it has been read back.
+ **
+ ** Usage:   util::StreamBuffers buffers(context, queues.size(),
+ **                                      ninputs, noutputs, chunk);
+ **          util::streamChunks(queues, buffers, inputs, outputs,
+ **                             count, kernel);
+ **          where kernel(queue, in, out, n) enqueues the operation on
+ **          the first n elements of the chunk buffers in and out. The
+ **          buffers are allocated once and reused by every call.
+ **
+ ** Note:    Must be included AFTER the relevant OpenCL header
+ **
+ **--------------------------------------------------------------------
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include "util.hpp"
+
+namespace util {
+
+  //! Enqueues the operation on n elements of the chunk buffers
+  typedef std::function<void(cl::CommandQueue& queue,
+                             const std::vector<cl::Buffer>& in,
+                             const std::vector<cl::Buffer>& out,
+                             size_t n)> ChunkKernel;
+
+  //! Time and traffic of a streamed operation
+  struct StreamResult
+  {
+    double seconds;   // host to host, uploads and downloads included
+    double bytes;     // moved between host and device
+    size_t chunks;
+
+    double bandwidth() const { return seconds > 0.0 ? bytes / seconds * 1e-9 : 0.0; }
+  };
+
+  /*!
+   * \brief Largest chunk (in floats) such that every queue can hold
+   * its nbuffers buffers within a quarter of the device memory, and
+   * each buffer within CL_DEVICE_MAX_MEM_ALLOC_SIZE
+   */
+  inline size_t streamChunkSize(const cl::Device& device, size_t nqueues, size_t nbuffers)
+  {
+    cl_ulong global = device.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>();
+    cl_ulong alloc = device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>();
+    cl_ulong bytes = std::min(alloc, global / 4 / (nqueues * nbuffers));
+    return (size_t) (bytes / sizeof(float));
+  }
+
+  /*!
+   * \brief The chunk buffers of every queue: ninputs read-only and
+   * noutputs write-only buffers of chunk floats (at least one)
+   */
+  class StreamBuffers
+  {
+    public:
+      StreamBuffers(const cl::Context& context, size_t nqueues,
+                    size_t ninputs, size_t noutputs, size_t chunk)
+        : chunk_(std::max(chunk, (size_t) 1)), in_(nqueues), out_(nqueues)
+      {
+        size_t chunk_bytes = sizeof(float) * chunk_;
+        for (size_t q = 0; q < nqueues; q++) {
+          for (size_t k = 0; k < ninputs; k++)
+            in_[q].push_back(cl::Buffer(context, CL_MEM_READ_ONLY, chunk_bytes));
+          for (size_t k = 0; k < noutputs; k++)
+            out_[q].push_back(cl::Buffer(context, CL_MEM_WRITE_ONLY, chunk_bytes));
+        }
+      }
+
+      size_t chunk() const { return chunk_; }
+      size_t queues() const { return in_.size(); }
+
+      const std::vector<cl::Buffer>& in(size_t q) const { return in_[q]; }
+      const std::vector<cl::Buffer>& out(size_t q) const { return out_[q]; }
+
+    private:
+      size_t chunk_;
+      std::vector<std::vector<cl::Buffer> > in_, out_;
+  };
+
+  /*!
+   * \brief out[k][0, count) = op(in[0][0, count), ...) in chunks of
+   * buffers.chunk() elements, chunk i on queue i % nqueues with the
+   * buffers of that queue. Blocks until the outputs are written back.
+   */
+  inline StreamResult streamChunks(std::vector<cl::CommandQueue>& queues,
+                                   const StreamBuffers& buffers,
+                                   const std::vector<const float*>& inputs,
+                                   const std::vector<float*>& outputs,
+                                   size_t count, const ChunkKernel& kernel)
+  {
+    size_t nqueues = std::min(queues.size(), buffers.queues());
+    size_t chunk = buffers.chunk();
+
+    StreamResult result = { 0.0, 0.0, 0 };
+    Timer timer;
+
+    for (size_t first = 0; first < count; first += chunk, result.chunks++) {
+      size_t q = result.chunks % nqueues;
+      size_t n = std::min(chunk, count - first);
+      size_t bytes = sizeof(float) * n;
+
+      const std::vector<cl::Buffer>& in = buffers.in(q);
+      const std::vector<cl::Buffer>& out = buffers.out(q);
+
+      for (size_t k = 0; k < inputs.size(); k++)
+        queues[q].enqueueWriteBuffer(in[k], CL_FALSE, 0, bytes, inputs[k] + first);
+      kernel(queues[q], in, out, n);
+      for (size_t k = 0; k < outputs.size(); k++)
+        queues[q].enqueueReadBuffer(out[k], CL_FALSE, 0, bytes, outputs[k] + first);
+
+      // Start this chunk now, while the next one is being enqueued
+      queues[q].flush();
+    }
+    for (size_t q = 0; q < nqueues; q++)
+      queues[q].finish();
+
+    result.seconds = static_cast<double>(timer.getTimeMicroseconds()) / 1e6;
+    result.bytes = (double) sizeof(float) * count * (inputs.size() + outputs.size());
+    return result;
+  }
+
+} // namespace util
@@ -14,10 +14,18 @@
 
 #include <cstdlib>
 
+#include "embedded_kernels.hpp"
+
 namespace util {
 
+  //! Source of a kernel: the copy embedded at build time if there is
+  //! one, otherwise the file input
   inline std::string loadProgram(std::string input)
   {
+    const EmbeddedSource* embedded = findEmbeddedKernel(input);
+    if (embedded)
+      return std::string(embedded->data, embedded->size);
+
     std::ifstream stream(input.c_str());
     if (!stream.is_open()) {
       std::cout << "Cannot open file: " << input << std::endl;
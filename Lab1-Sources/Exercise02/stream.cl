@@ -0,0 +1,64 @@
+/* ----------------------------------------------------------------
+ **
+ ** kernels: stream_copy, stream_scale, stream_add, stream_triad
+ **
+ ** Purpose: The four operations of the STREAM benchmark, one float
+ **          per work-item as in vadd:
+ **
+ **                copy   c = a             2 floats moved per element
+ **                scale  b = q*c           2
+ **                add    c = a + b         3
+ **                triad  a = b + q*c       3
+ **
+ ** input: float vectors of length count, q a float constant
+ **
+ ** ----------------------------------------------------------------
+ */
+
+__kernel void stream_copy(
+    __global const float* a,
+    __global float* c,
+    const unsigned int count)
+{
+  int i = get_global_id(0);
+  if(i < count)  {
+    c[i] = a[i];
+  }
+}
+
+__kernel void stream_scale(
+    __global float* b,
+    __global const float* c,
+    const float q,
+    const unsigned int count)
+{
+  int i = get_global_id(0);
+  if(i < count)  {
+    b[i] = q * c[i];
+  }
+}
+
+__kernel void stream_add(
+    __global const float* a,
+    __global const float* b,
+    __global float* c,
+    const unsigned int count)
+{
+  int i = get_global_id(0);
+  if(i < count)  {
+    c[i] = a[i] + b[i];
+  }
+}
+
+__kernel void stream_triad(
+    __global float* a,
+    __global const float* b,
+    __global const float* c,
+    const float q,
+    const unsigned int count)
+{
+  int i = get_global_id(0);
+  if(i < count)  {
+    a[i] = b[i] + q * c[i];
+  }
+}
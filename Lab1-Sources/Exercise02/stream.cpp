@@ -0,0 +1,329 @@
+/* ----------------------------------------------------------------
+ **
+ ** Name:       stream.cpp
+ **
+ ** Purpose:    Memory bandwidth of the host and of the OpenCL devices,
+ **             with the four operations of the STREAM benchmark:
+ **
+ **                   copy   c = a
+ **                   scale  b = q*c
+ **                   add    c = a + b
+ **                   triad  a = b + q*c
+ **
+ **             on the host (threads over slices of the arrays) and with
+ **             the kernels of stream.cl. The sizes go from arrays held
+ **             in L1 to arrays well beyond the last level cache, so the
+ **             GB/s of each level show up, and can be compared with
+ **             what vadd and the other elementwise kernels reach.
+ **
+ **             Small arrays repeat the operation in each timed run
+ **             (STREAM_BYTES), on the device as back to back launches
+ **             timed from the start of the first to the end of the last.
+ **
+ ** Usage:      ./stream02 [--device INDEX | --all-devices] [--size N,...]
+ **                        [--threads N] [--variant host|device|all]
+ ** ----------------------------------------------------------------
+ */
+
+#define __CL_ENABLE_EXCEPTIONS
+
+#include "cl.hpp"
+
+#include "util.hpp" // utility library
+#include "device_picker.hpp"
+#include "program_cache.hpp"
+#include "profiling.hpp"
+#include "benchmark.hpp"
+#include "host_vector.hpp"
+
+#include "err_code.h"
+
+#include <algorithm>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+#include <iostream>
+
+// ----------------------------------------------------------------
+
+#define TOL          (0.001)             // tolerance used in floating point comparisons
+#define SCALAR       3.0f                // q of scale and triad
+#define STREAM_SIZES "1024:33554432"     // default floats per array (--size): 4 KB to 128 MB
+#define STREAM_BYTES (1<<26)             // least traffic of a timed run, small arrays repeat
+
+// The operations, and the floats each one moves per element
+static const int   NKERNELS = 4;
+static const char* kernels[NKERNELS] = { "copy", "scale", "add", "triad" };
+static const int   floats[NKERNELS]  = { 2, 2, 3, 3 };
+
+// Operations in one timed run of kernel k on count elements
+static size_t repeats(int k, size_t count)
+{
+    return std::max<size_t>(1, STREAM_BYTES / (sizeof(float) * floats[k] * count));
+}
+
+// Kernel k on the elements [begin, end) of the host arrays
+static void hostKernel(int k, float* a, float* b, float* c, size_t begin, size_t end)
+{
+    const float q = SCALAR;
+    switch (k)
+    {
+        case 0: for (size_t i = begin; i < end; i++) c[i] = a[i];          break;
+        case 1: for (size_t i = begin; i < end; i++) b[i] = q * c[i];      break;
+        case 2: for (size_t i = begin; i < end; i++) c[i] = a[i] + b[i];   break;
+        case 3: for (size_t i = begin; i < end; i++) a[i] = b[i] + q * c[i]; break;
+    }
+}
+
+// Kernel k reps times on count elements. Each thread works on its own
+// slice, with at least 16K elements, so that small arrays stay in the
+// cache of one core
+static void hostRun(int k, float* a, float* b, float* c, size_t count, size_t reps, int nthreads)
+{
+    int threads = (int) std::min<size_t>(nthreads, std::max<size_t>(1, count / (1<<14)));
+    auto slice = [=](int t) {
+        size_t begin = count * t / threads, end = count * (t + 1) / threads;
+        for (size_t r = 0; r < reps; r++)
+            hostKernel(k, a, b, c, begin, end);
+    };
+
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; t++)
+        pool.push_back(std::thread(slice, t));
+    slice(0);
+    for (size_t t = 0; t < pool.size(); t++)
+        pool[t].join();
+}
+
+// Whether the output of kernel k matches its inputs
+static bool check(int k, const float* a, const float* b, const float* c, size_t count)
+{
+    const float q = SCALAR;
+    for (size_t i = 0; i < count; i++)
+    {
+        float tmp;
+        switch (k)
+        {
+            case 0:  tmp = c[i] - a[i];            break;
+            case 1:  tmp = b[i] - q * c[i];        break;
+            case 2:  tmp = c[i] - (a[i] + b[i]);   break;
+            default: tmp = a[i] - (b[i] + q * c[i]); break;
+        }
+        if (tmp*tmp >= TOL*TOL)
+            return false;
+    }
+    return true;
+}
+
+// Last level cache of the host in bytes, 0 if unknown
+static long hostCacheSize()
+{
+#ifdef _SC_LEVEL3_CACHE_SIZE
+    long size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    if (size <= 0)
+        size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    return size > 0 ? size : 0;
+#else
+    return 0;
+#endif
+}
+
+int main(int argc, char *argv[])
+{
+    cl_uint deviceIndex = 2;
+    RunOptions options(1024, 1, 5);
+    options.variant = "all";
+
+    bool allDevices = false;
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    options.addFlag("--all-devices", "Run on every device", &allDevices);
+    options.addNumber("--threads", "N", "Threads of the host runs", &threads, 1, 1024);
+    try
+    {
+        parseArguments(argc, argv, &deviceIndex, &options);
+    }
+    catch (cl::Error err)
+    {
+        std::cerr << "ERROR: " << err.what() << "(" << err_code(err.err()) << ")" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    int nthreads = (int) threads;
+    if (!options.sizeGiven)
+        parseSizes(STREAM_SIZES, &options.sizes);
+
+    util::Benchmark bench(options.warmup, options.iterations);
+    std::vector<std::string> targets;   // host or device of each group of results
+
+    // ------------------------------------------------------------------
+    // Host
+    // ------------------------------------------------------------------
+
+    if (options.variant == "all" || options.variant == "host")
+    {
+        printf("\nHost, %d threads, last level cache %ld KB\n", nthreads, hostCacheSize() / 1024);
+
+        std::vector<float> h_a, h_b, h_c;
+        for (size_t s = 0; s < options.sizes.size(); s++)
+        {
+            size_t count = options.sizes[s];
+            h_a.assign(count, 1.0f);
+            h_b.assign(count, 2.0f);
+            h_c.assign(count, 0.0f);
+            float *a = h_a.data(), *b = h_b.data(), *c = h_c.data();
+
+            for (int k = 0; k < NKERNELS; k++)
+            {
+                size_t reps = repeats(k, count);
+                bench.add(std::string("host_") + kernels[k], count,
+                          floats[k] * sizeof(float) * count * reps * 1e-9, "GB/s", [=]() {
+                    util::Timer timer;
+                    hostRun(k, a, b, c, count, reps, nthreads);
+                    return static_cast<double>(timer.getTimeMicroseconds()) / 1e6;
+                }, [=]() {
+                    return check(k, a, b, c, count);
+                });
+            }
+            bench.run();
+            targets.push_back("host");
+        }
+    }
+
+    // ------------------------------------------------------------------
+    // OpenCL devices
+    // ------------------------------------------------------------------
+
+    if (options.variant == "all" || options.variant == "device")
+    {
+        try
+        {
+            // Get list of devices
+            std::vector<cl::Device> devices;
+            unsigned numDevices = getDeviceList(devices);
+
+            // Check device index in range
+            if (!allDevices && deviceIndex >= numDevices)
+            {
+                std::cout << deviceIndex <<" Invalid device index (try '--list')\n";
+                return EXIT_FAILURE;
+            }
+
+            for (cl_uint d = 0; d < numDevices; d++)
+            {
+                if (!allDevices && d != deviceIndex)
+                    continue;
+
+                cl::Device device = devices[d];
+
+                std::string name;
+                getDeviceName(device, name);
+                printf("\nDevice %u: %s, global memory cache %lu KB\n", d, name.c_str(),
+                       (unsigned long) (device.getInfo<CL_DEVICE_GLOBAL_MEM_CACHE_SIZE>() / 1024));
+
+                std::vector<cl::Device> chosen_device;
+                chosen_device.push_back(device);
+                cl::Context context(chosen_device);
+                cl::CommandQueue queue = util::makeQueue(context, device);
+
+                cl::Program program = util::buildProgram(context, device, util::loadProgram("stream.cl"));
+                auto copy  = cl::make_kernel<cl::Buffer, cl::Buffer, unsigned int>(program, "stream_copy");
+                auto scale = cl::make_kernel<cl::Buffer, cl::Buffer, float, unsigned int>(program, "stream_scale");
+                auto add   = cl::make_kernel<cl::Buffer, cl::Buffer, cl::Buffer, unsigned int>(program, "stream_add");
+                auto triad = cl::make_kernel<cl::Buffer, cl::Buffer, cl::Buffer, float, unsigned int>(program, "stream_triad");
+
+                // Zero copy where the device shares the host memory, so
+                // that the checks read the arrays in place
+                util::HostVector::Mode mode = util::preferredMode(device);
+                char target[32];
+                snprintf(target, sizeof(target), "dev%u", d);
+
+                for (size_t s = 0; s < options.sizes.size(); s++)
+                {
+                    size_t count = options.sizes[s];
+                    util::HostVector a(context, count, mode), b(context, count, mode), c(context, count, mode);
+                    std::fill_n(a.map(queue, CL_MAP_WRITE), count, 1.0f);
+                    std::fill_n(b.map(queue, CL_MAP_WRITE), count, 2.0f);
+                    std::fill_n(c.map(queue, CL_MAP_WRITE), count, 0.0f);
+                    a.unmap(queue);
+                    b.unmap(queue);
+                    c.unmap(queue);
+
+                    auto launch = [&](int k) -> cl::Event {
+                        cl::EnqueueArgs args(queue, cl::NDRange(count));
+                        switch (k)
+                        {
+                            case 0:  return copy(args, a.buffer(), c.buffer(), count);
+                            case 1:  return scale(args, b.buffer(), c.buffer(), SCALAR, count);
+                            case 2:  return add(args, a.buffer(), b.buffer(), c.buffer(), count);
+                            default: return triad(args, a.buffer(), b.buffer(), c.buffer(), SCALAR, count);
+                        }
+                    };
+
+                    for (int k = 0; k < NKERNELS; k++)
+                    {
+                        size_t reps = repeats(k, count);
+                        bench.add(std::string(target) + "_" + kernels[k], count,
+                                  floats[k] * sizeof(float) * count * reps * 1e-9, "GB/s", [&, k, reps]() {
+                            cl::Event first = launch(k), last = first;
+                            for (size_t r = 1; r < reps; r++)
+                                last = launch(k);
+                            queue.finish();
+                            return util::getEventTimes(first, last).execution();
+                        }, [&, k]() {
+                            const float* h_a = a.map(queue, CL_MAP_READ);
+                            const float* h_b = b.map(queue, CL_MAP_READ);
+                            const float* h_c = c.map(queue, CL_MAP_READ);
+                            bool ok = check(k, h_a, h_b, h_c, count);
+                            a.unmap(queue);
+                            b.unmap(queue);
+                            c.unmap(queue);
+                            return ok;
+                        });
+                    }
+                    bench.run();
+                    targets.push_back(target);
+                }
+            }
+        }
+        catch (cl::Error err) {
+            std::cout << "Exception\n";
+            std::cerr
+                << "ERROR: "
+                << err.what()
+                << "("
+                << err_code(err.err())
+                << ")"
+                << std::endl;
+        }
+    }
+
+    // ------------------------------------------------------------------
+    // Median GB/s of each operation, by target and array size
+    // ------------------------------------------------------------------
+
+    const std::vector<util::Benchmark::Result>& results = bench.results();
+    printf("\n %-8s %12s", "target", "KB/array");
+    for (int k = 0; k < NKERNELS; k++)
+        printf(" %10s", kernels[k]);
+    printf("\n");
+    for (size_t g = 0; g < targets.size() && (g + 1) * NKERNELS <= results.size(); g++)
+    {
+        printf(" %-8s %12.1f", targets[g].c_str(), results[g * NKERNELS].size * sizeof(float) / 1024.0);
+        for (int k = 0; k < NKERNELS; k++)
+        {
+            const util::Benchmark::Result& r = results[g * NKERNELS + k];
+            printf(" %10.2f%s", r.stats.median, r.valid ? "" : "!");
+        }
+        printf("\n");
+    }
+
+    if (options.sizes.size() > 1 || options.iterations > 1)
+        bench.print();
+    if (!options.output.empty() && !bench.save(options.output))
+        std::cout << "Cannot write " << options.output << std::endl;
+}
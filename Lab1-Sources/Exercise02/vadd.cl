@@ -17,8 +17,42 @@ __kernel void vadd(
     __global float* c,
     const unsigned int count)
 {
-  int i = get_global_id(0);
+  size_t i = get_global_id(0);
   if(i < count)  {
     c[i] = a[i] + b[i];
   }
 }
+
+/* ----------------------------------------------------------------
+ **
+ ** kernels: vadd2, vadd4, vadd8, vadd16
+ **
+ ** Purpose: vadd on N floats per work-item, with vloadN/vstoreN so
+ **          that CPU runtimes use their wide SIMD registers. Launched
+ **          on ceil(count/N) work-items: the last one, when count is
+ **          not a multiple of N, adds the tail one float at a time.
+ **
+ ** ----------------------------------------------------------------
+ */
+
+#define VADD_VECTOR(N)                                                \
+__kernel void vadd##N(                                                \
+    __global float* a,                                                \
+    __global float* b,                                                \
+    __global float* c,                                                \
+    const unsigned int count)                                         \
+{                                                                     \
+  size_t i = get_global_id(0);                                        \
+  if((i + 1) * N <= count)  {                                         \
+    vstore##N(vload##N(i, a) + vload##N(i, b), i, c);                 \
+  }                                                                   \
+  else  {                                                             \
+    for(size_t j = i * N; j < count; j++)                             \
+      c[j] = a[j] + b[j];                                             \
+  }                                                                   \
+}
+
+VADD_VECTOR(2)
+VADD_VECTOR(4)
+VADD_VECTOR(8)
+VADD_VECTOR(16)
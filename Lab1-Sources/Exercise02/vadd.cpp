@@ -5,6 +5,20 @@
  ** Purpose:    Elementwise addition of two vectors (c = a + b)
  **
  **                   c = a + b
+ **
+ **             The vectors are util::HostVector: on devices sharing the
+ **             host memory (CL_DEVICE_HOST_UNIFIED_MEMORY, the default
+ **             CPU device) the kernel works in place on page aligned
+ **             host arrays and the host reads c by mapping it, with no
+ **             copy. --buffers copy|use_host_ptr|alloc_host_ptr|auto
+ **             forces a mode.
+ **
+ **             The kernel adds CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT
+ **             floats per work-item (vadd2 ... vadd16 in vadd.cl, the
+ **             last work-item adding the tail one float at a time);
+ **             --variant vadd|vadd4|... picks a width, --variant all
+ **             compares them all and --variant auto (the default)
+ **             keeps the preferred one.
  ** ----------------------------------------------------------------
  */
 
@@ -14,13 +28,19 @@
 
 #include "util.hpp" // utility library
 #include "device_picker.hpp"
+#include "program_cache.hpp"
+#include "profiling.hpp"
+#include "benchmark.hpp"
+#include "host_vector.hpp"
 
 #include "err_code.h"
 
 #include <vector>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <string>
+#include <algorithm>
 
 #include <iostream>
 #include <fstream>
@@ -33,30 +53,42 @@
 // ----------------------------------------------------------------
 
 #define TOL    (0.001)   // tolerance used in floating point comparisons
-#define LENGTH (1<<5)    // length of vectors a, b, and c
+#define LENGTH (1<<5)    // default length of vectors a, b, and c (--size)
 
-int main(int argc, char *argv[])
+// Width of the vadd kernel for a preferred vector width: the largest
+// of 1, 2, 4, 8 and 16 not above it
+static cl_uint vaddWidth(cl_uint preferred)
 {
-    std::vector<float> h_a(LENGTH);                // a vector
-    std::vector<float> h_b(LENGTH);                // b vector
-    std::vector<float> h_c (LENGTH, 0xdeadbeef);    // c = a + b, from compute device
-
-    cl::Buffer d_a;                        // device memory used for the input  a vector
-    cl::Buffer d_b;                        // device memory used for the input  b vector
-    cl::Buffer d_c;                       // device memory used for the output c vector
+    cl_uint width = 1;
+    while (width < 16 && width * 2 <= preferred)
+        width *= 2;
+    return width;
+}
 
-    // Fill vectors a and b with random float values
-    int count = LENGTH;
-    for(int i = 0; i < count; i++)
-    {
-        h_a[i]  = rand() / (float)RAND_MAX;
-        h_b[i]  = rand() / (float)RAND_MAX;
-    }
+// vadd for width 1, vadd<width> otherwise (vadd.cl)
+static std::string vaddKernelName(cl_uint width)
+{
+    return width == 1 ? "vadd" : "vadd" + std::to_string(width);
+}
 
+int main(int argc, char *argv[])
+{
     try
     {
         cl_uint deviceIndex = 2;
-        parseArguments(argc, argv, &deviceIndex);
+        RunOptions options(LENGTH, 0, 1);
+        std::string buffers = "auto";
+        options.addChoice("--buffers", "MODE", "Host buffers: auto, copy, use_host_ptr or alloc_host_ptr",
+                          &buffers, "auto|copy|use_host_ptr|alloc_host_ptr");
+        parseArguments(argc, argv, &deviceIndex, &options);
+
+        // The kernels of vadd.cl take the count as a uint
+        for (size_t s = 0; s < options.sizes.size(); s++)
+            if (options.sizes[s] > CL_UINT_MAX)
+            {
+                std::cout << "Invalid size " << options.sizes[s] << " (at most " << CL_UINT_MAX << " elements)\n";
+                return EXIT_FAILURE;
+            }
 
         // Get list of devices
         std::vector<cl::Device> devices;
@@ -75,67 +107,172 @@ int main(int argc, char *argv[])
         getDeviceName(device, name);
         std::cout << "\nUsing OpenCL device: " << name << "\n";
 
+        util::HostVector::Mode mode = util::parseMode(buffers, device);
+        std::cout << "Host buffers: " << util::HostVector::modeName(mode)
+                  << (device.getInfo<CL_DEVICE_HOST_UNIFIED_MEMORY>() ? " (unified memory)" : "") << "\n";
+
         std::vector<cl::Device> chosen_device;
         chosen_device.push_back(device);
         cl::Context context(chosen_device);
 
         // Load in kernel source, creating a program object for the context
-        cl::Program program(context, util::loadProgram("vadd.cl"), true);
+        cl::Program program = util::buildProgram(context, device, util::loadProgram("vadd.cl"));
+
+        // Get the command queue, with profiling to time the kernel on the device
+        cl::CommandQueue queue = util::makeQueue(context, device);
+
+        // Kernels to run: the width preferred by the device (--variant
+        // auto), every width with --variant all, or the one named by
+        // --variant (vadd4, ...)
+        std::vector<cl_uint> widths;
+        cl_uint preferred = vaddWidth(device.getInfo<CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT>());
+        if (options.variant == "all")
+            for (cl_uint w = 1; w <= 16; w *= 2)
+                widths.push_back(w);
+        else if (options.variant.compare(0, 4, "vadd") == 0)
+        {
+            // Only the widths of vadd.cl, not the nearest one below
+            cl_uint width = vaddWidth(atoi(options.variant.c_str() + 4));
+            if (options.variant != vaddKernelName(width) &&
+                options.variant != "vadd" + std::to_string(width))
+            {
+                std::cout << "Invalid variant " << options.variant
+                          << " (vadd, vadd2, vadd4, vadd8, vadd16, all or auto)\n";
+                return EXIT_FAILURE;
+            }
+            widths.push_back(width);
+        }
+        else if (options.variant.empty() || options.variant == "auto")
+            widths.push_back(preferred);
+        else
+        {
+            std::cout << "Invalid variant " << options.variant
+                      << " (vadd, vadd2, vadd4, vadd8, vadd16, all or auto)\n";
+            return EXIT_FAILURE;
+        }
+        std::cout << "Preferred float vector width: " << preferred << "\n";
+
+        util::Benchmark bench(options.warmup, options.iterations);
+
+        // One run per vector length given by --size
+        for (size_t s = 0; s < options.sizes.size(); s++)
+        {
+            size_t count = options.sizes[s];
+
+            // a and b, c = a + b from the compute device
+            util::HostVector a(context, count, mode, CL_MEM_READ_ONLY);
+            util::HostVector b(context, count, mode, CL_MEM_READ_ONLY);
+            util::HostVector c(context, count, mode, CL_MEM_WRITE_ONLY);
 
-        // Get the command queue
-        cl::CommandQueue queue(context);
+            // Fill vectors a and b with random float values, in place
+            float* h_a = a.map(queue, CL_MAP_WRITE);
+            float* h_b = b.map(queue, CL_MAP_WRITE);
+            for(size_t i = 0; i < count; i++)
+            {
+                h_a[i]  = rand() / (float)RAND_MAX;
+                h_b[i]  = rand() / (float)RAND_MAX;
+            }
+            a.unmap(queue);
+            b.unmap(queue);
 
-        // Create the kernel functor
-        auto vadd = cl::make_kernel<cl::Buffer, cl::Buffer, cl::Buffer, int>(program, "vadd");
+            printf("\nvadd, %zu elements\n", count);
+            for (size_t w = 0; w < widths.size(); w++)
+            {
+                // Create the kernel functor: one work-item per width floats
+                std::string kernel = vaddKernelName(widths[w]);
+                auto vadd = cl::make_kernel<cl::Buffer, cl::Buffer, cl::Buffer, cl_uint>(program, kernel);
+                cl::NDRange global((count + widths[w] - 1) / widths[w]);
 
-        d_a   = cl::Buffer(context, begin(h_a), end(h_a), true);
-        d_b   = cl::Buffer(context, begin(h_b), end(h_b), true);
+                // Garbage in c, so that a kernel missing elements fails the check
+                std::fill_n(c.map(queue, CL_MAP_WRITE), count, (float) 0xdeadbeef);
+                c.unmap(queue);
 
-        d_c  = cl::Buffer(context, CL_MEM_WRITE_ONLY, sizeof(float) * LENGTH);
+                util::Timer timer;
+                util::EventTimes times;
+                double rtime = 0.0;
+                size_t correct = 0;
 
-        util::Timer timer;
+                bench.add(kernel, count, 3.0 * sizeof(float) * count * 1e-9, "GB/s", [&]() {
+                    timer.reset();
 
-        vadd(
-                cl::EnqueueArgs(
-                    queue,
-                    cl::NDRange(count)),
-                d_a,
-                d_b,
-                d_c,
-                count);
+                    cl::Event event = vadd(
+                            cl::EnqueueArgs(
+                                queue,
+                                global),
+                            a.buffer(),
+                            b.buffer(),
+                            c.buffer(),
+                            (cl_uint) count);
 
-        queue.finish();
+                    queue.finish();
 
-        double rtime = static_cast<double>(timer.getTimeMilliseconds()) / 1000.0;
-        printf("\nThe kernels ran in %lf seconds\n", rtime);
+                    rtime = static_cast<double>(timer.getTimeMicroseconds()) / 1e6;
+                    times = util::getEventTimes(event);
+                    return times.execution();
+                }, [&]() {
+                    const float* h_a = a.map(queue, CL_MAP_READ);
+                    const float* h_b = b.map(queue, CL_MAP_READ);
+                    const float* h_c = c.map(queue, CL_MAP_READ);
 
-        cl::copy(queue, d_c, begin(h_c), end(h_c));
+                    // Test the results
+                    correct = 0;
+                    float tmp;
+                    for(size_t i = 0; i < count; i++) {
+                        tmp = h_a[i] + h_b[i]; // expected value for d_c[i]
+                        tmp -= h_c[i];                      // compute errors
+                        if(tmp*tmp < TOL*TOL) {      // correct if square deviation is less
+                            correct++;                         //  than tolerance squared
+                        }
+                        else {
 
-        // Test the results
-        int correct = 0;
-        float tmp;
-        for(int i = 0; i < count; i++) {
-            tmp = h_a[i] + h_b[i]; // expected value for d_c[i]
-            tmp -= h_c[i];                      // compute errors
-            if(tmp*tmp < TOL*TOL) {      // correct if square deviation is less
-                correct++;                         //  than tolerance squared
-            }
-            else {
+                            printf(
+                                    " tmp %f h_a %f h_b %f  h_c %f \n",
+                                    tmp,
+                                    h_a[i],
+                                    h_b[i],
+                                    h_c[i]);
+                        }
+                    }
+                    a.unmap(queue);
+                    b.unmap(queue);
+                    c.unmap(queue);
+                    return correct == count;
+                });
+
+                // Host to host: a and b handed to the device, c back to the host
+                bench.add(kernel + "_" + util::HostVector::modeName(mode), count,
+                          3.0 * sizeof(float) * count * 1e-9, "GB/s", [&]() {
+                    util::Timer total;
+
+                    a.map(queue, CL_MAP_WRITE);
+                    b.map(queue, CL_MAP_WRITE);
+                    a.unmap(queue);
+                    b.unmap(queue);
+                    vadd(cl::EnqueueArgs(queue, global),
+                         a.buffer(), b.buffer(), c.buffer(), (cl_uint) count);
+                    c.map(queue, CL_MAP_READ);
+                    c.unmap(queue);
+
+                    return static_cast<double>(total.getTimeMicroseconds()) / 1e6;
+                });
+                bench.run();
+
+                printf("\nThe kernels ran in %lf seconds (%lf seconds on the device, %.2f GB/s)\n",
+                       rtime, times.execution(), 3.0 * sizeof(float) * count / times.execution() * 1e-9);
+                util::printEventTimes(kernel, times);
 
+                // summarize results
                 printf(
-                        " tmp %f h_a %f h_b %f  h_c %f \n",
-                        tmp,
-                        h_a[i],
-                        h_b[i],
-                        h_c[i]);
+                        "vector add to find C = A+B:  %zu out of %zu results were correct.\n",
+                        correct,
+                        count);
             }
         }
 
-        // summarize results
-        printf(
-                "vector add to find C = A+B:  %d out of %d results were correct.\n",
-                correct,
-                count);
+        if (options.sizes.size() > 1 || options.iterations > 1)
+            bench.print();
+        if (!options.output.empty() && !bench.save(options.output))
+            std::cout << "Cannot write " << options.output << std::endl;
     }
     catch (cl::Error err) {
         std::cout << "Exception\n";
@@ -15,11 +15,20 @@
 
 #include "util.hpp" // utility library
 #include "device_picker.hpp"
+#include "program_cache.hpp"
+#include "profiling.hpp"
+#include "benchmark.hpp"
+#include "elementwise.hpp"
+#include "buffer_pool.hpp"
+#include "streaming.hpp"
 
 #include <vector>
 #include <cstdio>
 #include <cstdlib>
 #include <string>
+#include <cstring>
+#include <algorithm>
+#include <memory>
 
 #include <iostream>
 #include <fstream>
@@ -34,17 +43,19 @@
 // ----------------------------------------------------------------
 
 #define TOL    (0.001)   // tolerance used in floating point comparisons
-#define LENGTH (16777216)    // length of vectors a, b, and c
+#define LENGTH (16777216)    // default length of vectors a, b, and c (--size)
+#define STREAM_QUEUES 3      // queues of the streamed method (fourth method)
+#define STREAM_CHUNK (1<<22) // default chunk of the streamed method (--chunk)
 
 int main(int argc, char *argv[])
 {
-  std::vector<float> h_a(LENGTH);                // a vector
-  std::vector<float> h_b(LENGTH);                // b vector
-  std::vector<float> h_c(LENGTH, 0xdeadbeef);    // c = a + b, from compute device
-  std::vector<float> h_d(LENGTH);                // d = c + e vector
-  std::vector<float> h_e(LENGTH);                // e vector
-  std::vector<float> h_f(LENGTH);                // f = d + g, from compute device
-  std::vector<float> h_g(LENGTH);
+  std::vector<float> h_a;                // a vector
+  std::vector<float> h_b;                // b vector
+  std::vector<float> h_c;                // c = a + b, from compute device
+  std::vector<float> h_d;                // d = c + e vector
+  std::vector<float> h_e;                // e vector
+  std::vector<float> h_f;                // f = d + g, from compute device
+  std::vector<float> h_g;
 
   cl::Buffer d_a;                        // device memory used for the input  a vector
   cl::Buffer d_b;                        // device memory used for the input  b vector
@@ -54,21 +65,15 @@ int main(int argc, char *argv[])
   cl::Buffer d_f;
   cl::Buffer d_g;
 
-
-  // Fill vectors a and b with random float values
   int count = LENGTH;
-  for(int i = 0; i < count; i++)
-  {
-    h_a[i]  = rand() / (float)RAND_MAX;
-    h_b[i]  = rand() / (float)RAND_MAX;
-    h_e[i]  = rand() / (float)RAND_MAX;
-    h_g[i] = rand() / (float)RAND_MAX;
-  }
 
   try
   {
       cl_uint deviceIndex = 2;
-      parseArguments(argc, argv, &deviceIndex);
+      RunOptions options(LENGTH, 0, 1);
+      size_t chunkOption = 0;
+      options.addNumber("--chunk", "N", "Floats per chunk of the stream variant", &chunkOption);
+      parseArguments(argc, argv, &deviceIndex, &options);
 
         // Get list of devices
         std::vector<cl::Device> devices;
@@ -177,55 +182,249 @@ int main(int argc, char *argv[])
 */
 //________________________________________________________________________
 
-    std::cout << "Deuxième méthode :"<<std::endl;
+    // --variant stream runs the fourth method alone, without the full
+    // length device buffers of the others, for vectors that do not fit
+    bool stream = options.variant == "stream";
+    if (!stream)
+      std::cout << "Deuxième méthode :"<<std::endl;
 
     // Load in kernel source, creating a program object for the context
-    cl::Program program(context, util::loadProgram("vaddBis.cl"), true);
+    cl::Program program = util::buildProgram(context, device, util::loadProgram("vaddBis.cl"));
 
-    // Get the command queue
-    cl::CommandQueue queue(context);
+    // Get the command queue, with profiling to time the kernel on the device
+    cl::CommandQueue queue = util::makeQueue(context, device);
 
     // Create the kernel functor
 
     cl::make_kernel<cl::Buffer, cl::Buffer, cl::Buffer, cl::Buffer, cl::Buffer, cl::Buffer, cl::Buffer,int> vaddBis(program, "vaddBis");
-    util::Timer timer2;
 
-    //_____________
-
-    d_a  = cl::Buffer(context, h_a.begin(), h_a.end(), true);
-    d_b  = cl::Buffer(context, h_b.begin(), h_b.end(), true);
-    d_c  = cl::Buffer(context, CL_MEM_READ_WRITE, sizeof(float) * LENGTH);
-    d_d  = cl::Buffer(context, CL_MEM_READ_WRITE, sizeof(float) * LENGTH);
-    d_e  = cl::Buffer(context, h_e.begin(), h_e.end(), true);
-    d_f  = cl::Buffer(context, CL_MEM_READ_WRITE, sizeof(float) * LENGTH);
-    d_g  = cl::Buffer(context, h_g.begin(), h_g.end(), true);
+    // Device buffers, recycled from one size to the next
+    util::BufferPool pool(context);
+
+    // Fused kernels generated from expressions (third method)
+    util::ElementwiseEngine engine(context, device, queue);
+
+    // Queues of the streamed method, and its chunk size in floats (the
+    // default is lowered so that the chunk buffers fit on the device).
+    // The chunk buffers (4 inputs, 1 output per queue) are allocated
+    // once, for all the sizes and repetitions.
+    std::vector<cl::CommandQueue> stream_queues;
+    size_t chunk = chunkOption ? chunkOption
+                               : std::min((size_t) STREAM_CHUNK, util::streamChunkSize(device, STREAM_QUEUES, 5));
+    std::unique_ptr<util::StreamBuffers> stream_buffers;
+    if (stream)
+    {
+      for (int q = 0; q < STREAM_QUEUES; q++)
+        stream_queues.push_back(util::makeQueue(context, device, false));
+      stream_buffers.reset(new util::StreamBuffers(context, STREAM_QUEUES, 4, 1, chunk));
+    }
 
-    vaddBis( cl::EnqueueArgs( queue, cl::NDRange(count)),
-        d_a, d_b, d_c, d_d, d_e, d_f, d_g, count);
+    util::Benchmark bench(options.warmup, options.iterations);
 
-    queue.finish();
+    // One run per vector length given by --size
+    for (size_t s = 0; s < options.sizes.size(); s++)
+    {
+      count = options.sizes[s];
 
-    cl::copy(queue, d_c, h_c.begin(), h_c.end());
-    cl::copy(queue, d_d, h_d.begin(), h_d.end());
-    cl::copy(queue, d_f, h_f.begin(), h_f.end());
+      // Fill vectors a, b, e and g with random float values
+      h_a.resize(count);
+      h_b.resize(count);
+      if (!stream)
+      {
+        h_c.assign(count, 0xdeadbeef);
+        h_d.resize(count);
+      }
+      h_e.resize(count);
+      h_f.resize(count);
+      h_g.resize(count);
+      for(int i = 0; i < count; i++)
+      {
+        h_a[i]  = rand() / (float)RAND_MAX;
+        h_b[i]  = rand() / (float)RAND_MAX;
+        h_e[i]  = rand() / (float)RAND_MAX;
+        h_g[i] = rand() / (float)RAND_MAX;
+      }
 
-    double rtime = static_cast<double>(timer2.getTimeMilliseconds()) / 1000.0;
-    std::cout<<"The kernels ran in "<<rtime <<" seconds"<<std::endl;
-    int correct = 0;
-    float tmp;
+//________________________________________________________________________
 
-    for(int i = 0; i < count; i++) {
-      tmp = h_a[i] + h_b[i] + h_e[i] + h_g[i]; // expected value for d_c[i]
-      tmp -= h_f[i];         // compute errors
-      if(tmp*tmp < TOL*TOL) {
-          correct++;
-      }
-      else {
-        std::cout<<"tmp "<<tmp <<", h_a " << h_a[i]
-          << ", h_b " << h_b[i] << ", h_c "<<h_c[i]<<std::endl;
+      if (stream)
+      {
+        std::cout << "Quatrième méthode : par morceaux de " << chunk << " sur "
+          << STREAM_QUEUES << " files" << std::endl;
+
+        // F = A + B + E + G from and to host memory, in chunks, so that the
+        // vectors need not fit on the device: the upload, kernel and download
+        // of successive chunks overlap on the queues. The rate is host to
+        // host, with the transfers (5 vectors moved).
+        std::vector<const float*> stream_in;
+        stream_in.push_back(h_a.data());
+        stream_in.push_back(h_b.data());
+        stream_in.push_back(h_e.data());
+        stream_in.push_back(h_g.data());
+        std::vector<float*> stream_out(1, h_f.data());
+        util::StreamResult streamed = { 0.0, 0.0, 0 };
+
+        std::fill(h_f.begin(), h_f.end(), 0.0f);
+        bench.add("stream_f", count, 5.0 * sizeof(float) * count * 1e-9, "GB/s", [&]() {
+          streamed = util::streamChunks(stream_queues, *stream_buffers, stream_in, stream_out, count,
+            [&](cl::CommandQueue& q, const std::vector<cl::Buffer>& in,
+                const std::vector<cl::Buffer>& out, size_t n) {
+              util::DeviceVector A(in[0], n), B(in[1], n), E(in[2], n), G(in[3], n), F(out[0], n);
+              engine.enqueue(q, util::store(F, A + B + E + G));
+            });
+          return streamed.seconds;
+        }, [&]() {
+          for(int i = 0; i < count; i++) {
+            float tmp = h_a[i] + h_b[i] + h_e[i] + h_g[i] - h_f[i];
+            if(tmp*tmp >= TOL*TOL)
+              return false;
+          }
+          return true;
+        });
+        bench.run();
+        std::cout << " " << streamed.chunks << " chunks, " << streamed.bandwidth()
+          << " GB/s end to end" << std::endl;
+        continue;
       }
+
+//________________________________________________________________________
+
+      //_____________
+
+      // Device buffers from the pool: the inputs are uploaded once and stay
+      // resident for all the methods, and a size seen before allocates nothing
+      size_t bytes = sizeof(float) * count;
+      d_a  = pool.resident(queue, h_a.data(), bytes);
+      d_b  = pool.resident(queue, h_b.data(), bytes);
+      d_c  = pool.acquire(bytes);
+      d_d  = pool.acquire(bytes);
+      d_e  = pool.resident(queue, h_e.data(), bytes);
+      d_f  = pool.acquire(bytes);
+      d_g  = pool.resident(queue, h_g.data(), bytes);
+
+      // Device time of the fused kernel alone: 4 vectors read, 3 written,
+      // and wall time of its enqueue and wait, in the last repetition
+      util::Timer timer2;
+      util::EventTimes times;
+      double rtime = 0.0;
+      int correct = 0;
+
+      std::cout << "vaddBis, " << count << " elements" << std::endl;
+      bench.add("vaddBis", count, 7.0 * sizeof(float) * count * 1e-9, "GB/s", [&]() {
+        timer2.reset();
+        cl::Event event = vaddBis( cl::EnqueueArgs( queue, cl::NDRange(count)),
+            d_a, d_b, d_c, d_d, d_e, d_f, d_g, count);
+
+        queue.finish();
+
+        rtime = static_cast<double>(timer2.getTimeMicroseconds()) / 1e6;
+        times = util::getEventTimes(event);
+        return times.execution();
+      }, [&]() {
+        cl::copy(queue, d_c, h_c.begin(), h_c.end());
+        cl::copy(queue, d_d, h_d.begin(), h_d.end());
+        cl::copy(queue, d_f, h_f.begin(), h_f.end());
+
+        correct = 0;
+        float tmp;
+
+        for(int i = 0; i < count; i++) {
+          tmp = h_a[i] + h_b[i] + h_e[i] + h_g[i]; // expected value for d_c[i]
+          tmp -= h_f[i];         // compute errors
+          if(tmp*tmp < TOL*TOL) {
+              correct++;
+          }
+          else {
+            std::cout<<"tmp "<<tmp <<", h_a " << h_a[i]
+              << ", h_b " << h_b[i] << ", h_c "<<h_c[i]<<std::endl;
+          }
+        }
+        return correct == count;
+      });
+      bench.run();
+
+      std::cout<<"The kernels ran in "<<rtime <<" seconds"<<std::endl;
+
+      std::cout<<"vaddBis ran in "<<times.execution() <<" seconds on the device, "
+        << 7.0 * sizeof(float) * count / times.execution() * 1e-9 <<" GB/s"<<std::endl;
+      util::printEventTimes("vaddBis", times);
+
+      // summarize results
+      std::cout<< "vector add to find F = A + B + E + G: " << correct <<" "
+        << "out of "<<count<<" results were correct."<< std::endl;
+
+//________________________________________________________________________
+
+      std::cout << "Troisième méthode :"<<std::endl;
+
+      // One generated kernel for F = A + B + E + G: with F alone, c and d
+      // stay in registers (4 vectors read, 1 written); asking for C and D
+      // too gives the traffic of vaddBis
+      util::DeviceVector A(d_a, count), B(d_b, count), C(d_c, count), D(d_d, count),
+                         E(d_e, count), F(d_f, count), G(d_g, count);
+
+      util::Benchmark::Check check_f = [&]() {
+        cl::copy(queue, d_f, h_f.begin(), h_f.end());
+        for(int i = 0; i < count; i++) {
+          float tmp = h_a[i] + h_b[i] + h_e[i] + h_g[i] - h_f[i];
+          if(tmp*tmp >= TOL*TOL)
+            return false;
+        }
+        return true;
+      };
+
+      // f is cleared first, so that the check sees what the kernel wrote
+      queue.enqueueFillBuffer(d_f, 0.0f, 0, sizeof(float) * count);
+      bench.add("fused_f", count, 5.0 * sizeof(float) * count * 1e-9, "GB/s", [&]() {
+        cl::Event event = engine.evaluate(util::store(F, A + B + E + G));
+        queue.finish();
+        return util::getEventTimes(event).execution();
+      }, check_f);
+      bench.run();
+
+      // The intermediates are checked as well, cleared like f
+      util::Benchmark::Check check_cdf = [&]() {
+        if (!check_f())
+          return false;
+        cl::copy(queue, d_c, h_c.begin(), h_c.end());
+        cl::copy(queue, d_d, h_d.begin(), h_d.end());
+        for(int i = 0; i < count; i++) {
+          float tmp_c = h_a[i] + h_b[i] - h_c[i];
+          float tmp_d = h_a[i] + h_b[i] + h_e[i] - h_d[i];
+          if(tmp_c*tmp_c >= TOL*TOL || tmp_d*tmp_d >= TOL*TOL)
+            return false;
+        }
+        return true;
+      };
+
+      queue.enqueueFillBuffer(d_c, 0.0f, 0, sizeof(float) * count);
+      queue.enqueueFillBuffer(d_d, 0.0f, 0, sizeof(float) * count);
+      queue.enqueueFillBuffer(d_f, 0.0f, 0, sizeof(float) * count);
+      bench.add("fused_cdf", count, 7.0 * sizeof(float) * count * 1e-9, "GB/s", [&]() {
+        auto c = A + B;
+        auto d = c + E;
+        cl::Event event = engine.evaluate(util::store(F, d + G), util::store(C, c), util::store(D, d));
+        queue.finish();
+        return util::getEventTimes(event).execution();
+      }, check_cdf);
+      bench.run();
+
+      // Back to the pool for the next size (the host vectors are refilled)
+      pool.evict(h_a.data());
+      pool.evict(h_b.data());
+      pool.evict(h_e.data());
+      pool.evict(h_g.data());
+      pool.release(d_c);
+      pool.release(d_d);
+      pool.release(d_f);
+      pool.printStats("buffer pool");
     }
 
+    if (options.sizes.size() > 1 || options.iterations > 1)
+      bench.print();
+    if (!options.output.empty() && !bench.save(options.output))
+      std::cout << "Cannot write " << options.output << std::endl;
+
   }
   catch (cl::Error err) {
     std::cout << "Exception\n";
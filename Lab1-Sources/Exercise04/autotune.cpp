@@ -0,0 +1,264 @@
+/* ----------------------------------------------------------------
+**
+**  PROGRAM: Autotuning of the mmul tiles
+**
+**  PURPOSE: Grid of tile sizes, benchmark of each one and the file
+**           of tuned configurations, see autotune.hpp.
+**
+** ----------------------------------------------------------------
+*/
+
+#include "autotune.hpp"
+#include "util.hpp"
+#include "program_cache.hpp"
+#include "profiling.hpp"
+
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <unistd.h>
+
+// Smallest multiple of m not smaller than n
+static size_t round_up(size_t n, size_t m)
+{
+    return (n + m - 1) / m * m;
+}
+
+MmulConfig::MmulConfig(const std::string& kernel_)
+    : kernel(kernel_), tileWidth(TILE_WIDTH), ts(TS), wpt(WPT), tsk(TSK), gflops(0.0)
+{
+}
+
+std::string MmulConfig::buildOptions() const
+{
+    std::ostringstream options;
+    options << "-DTILE_WIDTH=" << tileWidth << " -DTS=" << ts
+            << " -DWPT=" << wpt << " -DTSK=" << tsk;
+    return options.str();
+}
+
+cl::NDRange MmulConfig::local() const
+{
+    if (kernel == "mmul_reg")
+        return cl::NDRange(ts / wpt, ts / wpt);
+    if (kernel == "mmul_vec")
+        return cl::NDRange(tileWidth / 4, tileWidth);
+    return cl::NDRange(tileWidth, tileWidth);
+}
+
+cl::NDRange MmulConfig::global(int N) const
+{
+    if (kernel == "mmul_reg")
+        return cl::NDRange(round_up(N, ts) / wpt, round_up(N, ts) / wpt);
+    if (kernel == "mmul_vec")
+        return cl::NDRange(round_up(N, tileWidth) / 4, round_up(N, tileWidth));
+    return cl::NDRange(round_up(N, tileWidth), round_up(N, tileWidth));
+}
+
+std::string MmulConfig::describe() const
+{
+    std::ostringstream s;
+    if (kernel == "mmul_reg")
+        s << "TS " << ts << ", WPT " << wpt << ", TSK " << tsk;
+    else
+        s << "TILE_WIDTH " << tileWidth;
+    return s.str();
+}
+
+int mmul_size_class(int N)
+{
+    int size = 1;
+    while (size < N)
+        size *= 2;
+    return size;
+}
+
+std::vector<MmulConfig> mmul_tuning_grid(const cl::Device& device, const std::string& kernel)
+{
+    size_t maxGroup = device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>();
+    cl_ulong localMem = device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>();
+
+    std::vector<MmulConfig> grid;
+    if (kernel == "mmul" || kernel == "mmul_db" || kernel == "mmul_vec")
+    {
+        // Two tiles of A and B, twice that with double buffering, padded
+        // by a float4 per row with float4 (which also needs 4 times fewer
+        // items)
+        bool vec = kernel == "mmul_vec";
+        size_t tiles = kernel == "mmul_db" ? 4 : 2;
+        for (int tile = 4; tile <= (vec ? 64 : 32); tile *= 2)
+        {
+            MmulConfig c(kernel);
+            c.tileWidth = tile;
+            size_t group = (size_t) tile * (vec ? tile / 4 : tile);
+            size_t bytes = tiles * sizeof(float) * tile * (vec ? tile + 4 : tile);
+            if (group <= maxGroup && bytes <= localMem)
+                grid.push_back(c);
+        }
+    }
+    else if (kernel == "mmul_reg")
+    {
+        for (int ts = 32; ts <= 128; ts *= 2)
+            for (int wpt = 2; wpt <= 8; wpt *= 2)
+                for (int tsk = 8; tsk <= 32; tsk *= 2)
+                {
+                    // The loads of a tile must spread evenly over the group
+                    size_t group = (size_t) (ts / wpt) * (ts / wpt);
+                    if (group > maxGroup || (ts * tsk) % group != 0)
+                        continue;
+                    if (2 * sizeof(float) * ts * tsk > localMem)
+                        continue;
+
+                    MmulConfig c(kernel);
+                    c.ts = ts;
+                    c.wpt = wpt;
+                    c.tsk = tsk;
+                    grid.push_back(c);
+                }
+    }
+    return grid;
+}
+
+MmulConfig autotune_mmul(const cl::Context& context, const cl::Device& device,
+                         cl::CommandQueue& queue, const std::string& kernel, int N,
+                         const cl::Buffer& A, const cl::Buffer& B, cl::Buffer& C,
+                         const util::Benchmark::Check& check, util::Benchmark& bench)
+{
+    std::string source = util::loadProgram("matmul.cl");
+    std::vector<MmulConfig> grid = mmul_tuning_grid(device, kernel);
+
+    MmulConfig best(kernel);
+    for (size_t g = 0; g < grid.size(); g++)
+    {
+        MmulConfig config = grid[g];
+        cl::Kernel k;
+        try
+        {
+            cl::Program program = util::buildProgram(context, device, source, config.buildOptions());
+            k = cl::Kernel(program, kernel.c_str());
+        }
+        catch (cl::Error&)
+        {
+            continue;   // does not build for this device
+        }
+
+        // The compiled kernel may allow less than the device maximum
+        cl::NDRange local = config.local();
+        if (local[0] * local[1] > k.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device))
+            continue;
+
+        k.setArg(0, N);
+        k.setArg(1, N);
+        k.setArg(2, N);
+        k.setArg(3, A);
+        k.setArg(4, B);
+        k.setArg(5, C);
+        cl::NDRange global = config.global(N);
+
+        // C starts as NaN, so that a configuration leaving part of it
+        // unwritten cannot pass on the results of the previous one. A
+        // launch that fails (resources, work-group size) skips it too.
+        try
+        {
+            queue.enqueueFillBuffer(C, std::numeric_limits<float>::quiet_NaN(), 0, sizeof(float) * N * N);
+            bench.add(kernel + " " + config.describe(), N, 2.0 * N * N * N * 1e-9, "GFLOPS", [=, &queue]() {
+                cl::Event event;
+                queue.enqueueNDRangeKernel(k, cl::NullRange, global, local, NULL, &event);
+                queue.finish();
+                return util::getEventTimes(event).execution();
+            }, check);
+            bench.run();
+        }
+        catch (cl::Error&)
+        {
+            continue;
+        }
+
+        const util::Benchmark::Result& r = bench.results().back();
+        if (r.valid && r.stats.median > best.gflops)
+        {
+            best = config;
+            best.gflops = r.stats.median;
+        }
+    }
+    return best;
+}
+
+// File of the tuned configurations, empty if the cache is disabled
+static std::string tuning_file()
+{
+    std::string dir = util::programCacheDir();
+    return dir.empty() ? "" : dir + "/mmul_tuning.txt";
+}
+
+// Same device and driver, as for the program binaries
+static std::string device_key(const cl::Device& device)
+{
+    std::ostringstream key;
+    key << std::hex << util::hashString(device.getInfo<CL_DEVICE_NAME>() + "|" +
+                                        device.getInfo<CL_DEVICE_VERSION>() + "|" +
+                                        device.getInfo<CL_DRIVER_VERSION>());
+    return key.str();
+}
+
+// Line layout: device key, kernel, size class, TILE_WIDTH, TS, WPT, TSK, GFLOPS
+bool load_mmul_tuning(const cl::Device& device, const std::string& kernel, int N,
+                      MmulConfig* config)
+{
+    std::string path = tuning_file();
+    if (path.empty())
+        return false;
+
+    std::ifstream in(path.c_str());
+    std::string key = device_key(device), line;
+    int sizeClass = mmul_size_class(N);
+    while (std::getline(in, line))
+    {
+        std::istringstream fields(line);
+        std::string k, name;
+        int size;
+        MmulConfig c;
+        if (fields >> k >> name >> size >> c.tileWidth >> c.ts >> c.wpt >> c.tsk >> c.gflops
+            && k == key && name == kernel && size == sizeClass)
+        {
+            c.kernel = kernel;
+            *config = c;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool save_mmul_tuning(const cl::Device& device, int N, const MmulConfig& config)
+{
+    std::string path = tuning_file();
+    if (path.empty() || !util::makeDirectories(util::programCacheDir()))
+        return false;
+
+    std::ostringstream prefix;
+    prefix << device_key(device) << " " << config.kernel << " " << mmul_size_class(N) << " ";
+
+    // Every other entry, then this one
+    std::ostringstream content;
+    std::ifstream in(path.c_str());
+    std::string line;
+    while (std::getline(in, line))
+        if (line.compare(0, prefix.str().size(), prefix.str()) != 0)
+            content << line << "\n";
+    in.close();
+    content << prefix.str() << config.tileWidth << " " << config.ts << " "
+            << config.wpt << " " << config.tsk << " " << config.gflops << "\n";
+
+    // Write then rename, as the program cache does
+    std::ostringstream tmp;
+    tmp << path << "." << getpid() << ".tmp";
+    std::ofstream out(tmp.str().c_str());
+    out << content.str();
+    out.close();
+    if (!out || std::rename(tmp.str().c_str(), path.c_str()) != 0)
+    {
+        std::remove(tmp.str().c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,89 @@
+/* ----------------------------------------------------------------
+**
+**  Autotuning of the tile sizes of mmul, mmul_db, mmul_vec and
+**  mmul_reg (matmul.cl)
+**
+**  The tile sizes are build options of matmul.cl (-DTILE_WIDTH for
+**  mmul, mmul_db and mmul_vec, -DTS -DWPT -DTSK for mmul_reg). The
+**  tuner builds the kernel for every combination of a grid that fits
+**  the device (work-group size, local memory), benchmarks each one on
+**  the product at hand and keeps the fastest correct one.
+**
+**  The results are kept on disk, next to the program binaries
+**  (util::programCacheDir(), file mmul_tuning.txt), one line per
+**  device, kernel and size class (the power of two at or above the
+**  order), so that later runs start with the tuned tiles.
+**
+** ----------------------------------------------------------------
+*/
+
+#ifndef __AUTOTUNE_HDR
+#define __AUTOTUNE_HDR
+
+#include "matmul.hpp"
+#include "benchmark.hpp"
+
+#include <string>
+#include <vector>
+
+struct MmulConfig
+{
+    std::string kernel;     // "mmul", "mmul_db", "mmul_vec" or "mmul_reg"
+    int         tileWidth;  // mmul, mmul_db, mmul_vec
+    int         ts;         // mmul_reg
+    int         wpt;
+    int         tsk;
+    double      gflops;     // measured by the tuner, 0 for the defaults
+
+    //! The tile sizes of matmul.hpp
+    explicit MmulConfig(const std::string& kernel_ = "mmul");
+
+    //! -D options giving these tiles to matmul.cl
+    std::string buildOptions() const;
+
+    //! Work-group and workspace for an order N product
+    cl::NDRange local() const;
+    cl::NDRange global(int N) const;
+
+    //! Tiles in words, e.g. "TS 64, WPT 4, TSK 16"
+    std::string describe() const;
+};
+
+//! Smallest power of two not smaller than N
+int mmul_size_class(int N);
+
+/* ----------------------------------------------------------------
+**
+**  The configurations of kernel worth trying on device
+**
+** ----------------------------------------------------------------
+*/
+std::vector<MmulConfig> mmul_tuning_grid(const cl::Device& device, const std::string& kernel);
+
+/* ----------------------------------------------------------------
+**
+**  Benchmarks every configuration of the grid on C = A * B of order
+**  N, each checked by check, and returns the fastest correct one
+**  (the defaults if none is). The results go to bench.
+**
+** ----------------------------------------------------------------
+*/
+MmulConfig autotune_mmul(const cl::Context& context, const cl::Device& device,
+                         cl::CommandQueue& queue, const std::string& kernel, int N,
+                         const cl::Buffer& A, const cl::Buffer& B, cl::Buffer& C,
+                         const util::Benchmark::Check& check, util::Benchmark& bench);
+
+/* ----------------------------------------------------------------
+**
+**  Tuned configuration of kernel for device and the size class of N
+**  from the file, false if there is none
+**
+** ----------------------------------------------------------------
+*/
+bool load_mmul_tuning(const cl::Device& device, const std::string& kernel, int N,
+                      MmulConfig* config);
+
+//! Stores config for device and the size class of N, replacing the previous one
+bool save_mmul_tuning(const cl::Device& device, int N, const MmulConfig& config);
+
+#endif
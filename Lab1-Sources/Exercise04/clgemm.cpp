@@ -0,0 +1,135 @@
+/* ----------------------------------------------------------------
+**
+**  PROGRAM: OpenCL general matrix product
+**
+**  PURPOSE: Host side of the gemm kernel of matmul.cl, see
+**           clgemm.hpp for the conventions.
+**
+** ----------------------------------------------------------------
+*/
+
+#include "clgemm.hpp"
+#include "util.hpp"
+#include "program_cache.hpp"
+
+#include <sstream>
+
+std::string matmul_build_options()
+{
+    std::ostringstream options;
+    options << "-DTILE_WIDTH=" << TILE_WIDTH << " -DTS=" << TS
+            << " -DWPT=" << WPT << " -DTSK=" << TSK << " -DBTILE=" << BTILE;
+    return options.str();
+}
+
+CLGemm::CLGemm(const cl::Context& context, const cl::Device& device)
+{
+    program_ = util::buildProgram(context, device, util::loadProgram("matmul.cl"),
+                                  matmul_build_options());
+    kernel_ = cl::Kernel(program_, "gemm");
+    strided_ = cl::Kernel(program_, "gemm_batched_strided");
+    batched_ = cl::Kernel(program_, "gemm_batched");
+}
+
+void CLGemm::operator()(cl::CommandQueue& queue,
+                        char transA, char transB, int M, int N, int K,
+                        float alpha, const cl::Buffer& A, int lda,
+                        const cl::Buffer& B, int ldb,
+                        float beta, cl::Buffer& C, int ldc,
+                        cl::Event* event)
+{
+    if (M <= 0 || N <= 0)
+        return;
+
+    kernel_.setArg(0, (cl_int) (transA == 'T' || transA == 't'));
+    kernel_.setArg(1, (cl_int) (transB == 'T' || transB == 't'));
+    kernel_.setArg(2, M);
+    kernel_.setArg(3, N);
+    kernel_.setArg(4, K);
+    kernel_.setArg(5, alpha);
+    kernel_.setArg(6, A);
+    kernel_.setArg(7, lda);
+    kernel_.setArg(8, B);
+    kernel_.setArg(9, ldb);
+    kernel_.setArg(10, beta);
+    kernel_.setArg(11, C);
+    kernel_.setArg(12, ldc);
+
+    // One work-item per WPT x WPT block of C, rounded up to whole groups
+    cl::NDRange global((N + TS - 1) / TS * (TS / WPT), (M + TS - 1) / TS * (TS / WPT));
+    cl::NDRange local(TS / WPT, TS / WPT);
+
+    queue.enqueueNDRangeKernel(kernel_, cl::NullRange, global, local, NULL, event);
+}
+
+// Arguments shared by the batched kernels, up to alpha
+static void set_batch_args(cl::Kernel& kernel, char transA, char transB,
+                           int M, int N, int K, float alpha)
+{
+    kernel.setArg(0, (cl_int) (transA == 'T' || transA == 't'));
+    kernel.setArg(1, (cl_int) (transB == 'T' || transB == 't'));
+    kernel.setArg(2, M);
+    kernel.setArg(3, N);
+    kernel.setArg(4, K);
+    kernel.setArg(5, alpha);
+}
+
+// One BTILE x BTILE group per tile of C_b, the third dimension over the batch
+static void enqueue_batch(cl::CommandQueue& queue, cl::Kernel& kernel,
+                          int M, int N, int first, int batch, cl::Event* event)
+{
+    cl::NDRange global((N + BTILE - 1) / BTILE * BTILE, (M + BTILE - 1) / BTILE * BTILE, batch);
+    cl::NDRange local(BTILE, BTILE, 1);
+
+    queue.enqueueNDRangeKernel(kernel, cl::NDRange(0, 0, first), global, local, NULL, event);
+}
+
+void CLGemm::batchedStrided(cl::CommandQueue& queue,
+                            char transA, char transB, int M, int N, int K,
+                            float alpha, const cl::Buffer& A, int lda, cl_ulong strideA,
+                            const cl::Buffer& B, int ldb, cl_ulong strideB,
+                            float beta, cl::Buffer& C, int ldc, cl_ulong strideC,
+                            int batch, int first, cl::Event* event)
+{
+    if (M <= 0 || N <= 0 || batch <= 0)
+        return;
+
+    set_batch_args(strided_, transA, transB, M, N, K, alpha);
+    strided_.setArg(6, A);
+    strided_.setArg(7, lda);
+    strided_.setArg(8, strideA);
+    strided_.setArg(9, B);
+    strided_.setArg(10, ldb);
+    strided_.setArg(11, strideB);
+    strided_.setArg(12, beta);
+    strided_.setArg(13, C);
+    strided_.setArg(14, ldc);
+    strided_.setArg(15, strideC);
+
+    enqueue_batch(queue, strided_, M, N, first, batch, event);
+}
+
+void CLGemm::batched(cl::CommandQueue& queue,
+                     char transA, char transB, int M, int N, int K,
+                     float alpha, const cl::Buffer& A, int lda, const cl::Buffer& offA,
+                     const cl::Buffer& B, int ldb, const cl::Buffer& offB,
+                     float beta, cl::Buffer& C, int ldc, const cl::Buffer& offC,
+                     int batch, cl::Event* event)
+{
+    if (M <= 0 || N <= 0 || batch <= 0)
+        return;
+
+    set_batch_args(batched_, transA, transB, M, N, K, alpha);
+    batched_.setArg(6, A);
+    batched_.setArg(7, lda);
+    batched_.setArg(8, offA);
+    batched_.setArg(9, B);
+    batched_.setArg(10, ldb);
+    batched_.setArg(11, offB);
+    batched_.setArg(12, beta);
+    batched_.setArg(13, C);
+    batched_.setArg(14, ldc);
+    batched_.setArg(15, offC);
+
+    enqueue_batch(queue, batched_, M, N, 0, batch, event);
+}
@@ -0,0 +1,74 @@
+/* ----------------------------------------------------------------
+**
+**  OpenCL general matrix product (kernel gemm of matmul.cl)
+**
+**      C = alpha * op(A) * op(B) + beta * C
+**
+**  Same conventions as the host gemm of matrix_lib.hpp: row major
+**  storage, leading dimensions lda, ldb, ldc and trans 'N' or 'T'.
+**
+**  Batches of small products (kernels gemm_batched*) go in a single
+**  launch, the third dimension of the NDRange running over the batch:
+**  X_b starts at float b*strideX of buffer X (batchedStrided) or at
+**  float offX[b], offX being a buffer of cl_ulong (batched, OpenCL 1.2
+**  having no pointers shared with the host).
+**
+** ----------------------------------------------------------------
+*/
+
+#ifndef __CLGEMM_HDR
+#define __CLGEMM_HDR
+
+#include "matmul.hpp"
+
+#include <string>
+
+/* ----------------------------------------------------------------
+**
+**  Build options giving matmul.cl the tile sizes of matmul.hpp
+**
+** ----------------------------------------------------------------
+*/
+std::string matmul_build_options();
+
+class CLGemm
+{
+    public:
+        //! Builds matmul.cl for device and creates the gemm kernel
+        CLGemm(const cl::Context& context, const cl::Device& device);
+
+        //! Enqueues C = alpha*op(A)*op(B) + beta*C on queue
+        void operator()(cl::CommandQueue& queue,
+                        char transA, char transB, int M, int N, int K,
+                        float alpha, const cl::Buffer& A, int lda,
+                        const cl::Buffer& B, int ldb,
+                        float beta, cl::Buffer& C, int ldc,
+                        cl::Event* event = NULL);
+
+        //! Enqueues C_b = alpha*op(A_b)*op(B_b) + beta*C_b for b = first ..
+        //! first+batch-1, X_b starting at float b*strideX of X
+        void batchedStrided(cl::CommandQueue& queue,
+                            char transA, char transB, int M, int N, int K,
+                            float alpha, const cl::Buffer& A, int lda, cl_ulong strideA,
+                            const cl::Buffer& B, int ldb, cl_ulong strideB,
+                            float beta, cl::Buffer& C, int ldc, cl_ulong strideC,
+                            int batch, int first = 0, cl::Event* event = NULL);
+
+        //! Same for b = 0 .. batch-1, X_b starting at float offX[b] of X
+        void batched(cl::CommandQueue& queue,
+                     char transA, char transB, int M, int N, int K,
+                     float alpha, const cl::Buffer& A, int lda, const cl::Buffer& offA,
+                     const cl::Buffer& B, int ldb, const cl::Buffer& offB,
+                     float beta, cl::Buffer& C, int ldc, const cl::Buffer& offC,
+                     int batch, cl::Event* event = NULL);
+
+        const cl::Program& program() const { return program_; }
+
+    private:
+        cl::Program program_;
+        cl::Kernel  kernel_;
+        cl::Kernel  strided_;   // gemm_batched_strided
+        cl::Kernel  batched_;   // gemm_batched
+};
+
+#endif
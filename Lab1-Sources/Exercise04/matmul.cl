@@ -1,6 +1,27 @@
+// Les tailles de tuiles peuvent être imposées par l'hôte (-DTILE_WIDTH=...)
+#ifndef TILE_WIDTH
 #define TILE_WIDTH 16
+#endif
 
-__kernel void _mmul(const int taille,
+// Tuiles de mmul_reg : un groupe calcule un bloc TS x TS de C, chaque
+// work-item un bloc WPT x WPT, en avançant de TSK selon k
+#ifndef TS
+#define TS 64
+#endif
+#ifndef WPT
+#define WPT 4
+#endif
+#ifndef TSK
+#define TSK 16
+#endif
+#define RTS (TS/WPT)
+
+// Toutes les matrices sont stockées par lignes : A est M x K, B est K x N
+// et C est M x N. Les dimensions quelconques sont gérées en lisant des
+// zéros hors des matrices et en n'écrivant que les éléments de C, l'hôte
+// arrondissant l'espace de travail au multiple de la taille des groupes.
+
+__kernel void _mmul(const int M, const int N, const int K,
    __global float* d_A,
    __global float* d_B,
    __global float* d_C)
@@ -8,22 +29,24 @@ __kernel void _mmul(const int taille,
   // Récupère le positionnement du thread dans l'espace de travail
   int tx = get_global_id(0);
   int ty = get_global_id(1);
+  if (tx >= N || ty >= M)
+    return;
 
    // sp mémorise la valeur courante du produit scalaire
    // réalisée par le thread
    float sp = 0;
-   for (int k = 0; k < taille; ++k)
+   for (int k = 0; k < K; ++k)
    {
-      float elementA = d_A[ty * taille + k];
-      float elementB = d_B[k * taille + tx];
+      float elementA = d_A[ty * K + k];
+      float elementB = d_B[k * N + tx];
       sp += elementA * elementB;
    }
 
    // Chaque thread écrit le résultat final en mémoire globale
-   d_C[ty * taille + tx] = sp;
+   d_C[ty * N + tx] = sp;
 }
 
-__kernel void mmul(const int taille,
+__kernel void mmul(const int M, const int N, const int K,
     __global float* d_A,
     __global float* d_B,
     __global float* d_C)
@@ -43,10 +66,12 @@ __kernel void mmul(const int taille,
 
   // Boucle sur l'ensemble les blocs de M et N necessaire pour
   // calculer un element de
-  for (int m = 0; m < taille/TILE_WIDTH; ++m) {
-    // Chargement collaboratif en memoire partagee
-    ds_M[ty][tx] = d_A[Row*taille + m*TILE_WIDTH+tx];
-    ds_N[ty][tx] = d_B[(m*TILE_WIDTH+ty)*taille+Col];
+  for (int m = 0; m < (K + TILE_WIDTH - 1)/TILE_WIDTH; ++m) {
+    // Chargement collaboratif en memoire partagee, zéro hors des matrices
+    int kA = m*TILE_WIDTH + tx;
+    int kB = m*TILE_WIDTH + ty;
+    ds_M[ty][tx] = (Row < M && kA < K) ? d_A[Row*K + kA] : 0.0f;
+    ds_N[ty][tx] = (kB < K && Col < N) ? d_B[kB*N + Col] : 0.0f;
 
     // Force la synchronisation à l'intérieur d'un groupe pour assurer
     // l'exactitude des calculs
@@ -59,5 +84,340 @@ __kernel void mmul(const int taille,
   }
 
   // Chaque thread écrit le résultat final en mémoire globale
-  d_C[Row*taille+Col] = sp;
+  if (Row < M && Col < N)
+    d_C[Row*N+Col] = sp;
+}
+
+// Variante de mmul à double tampon : la tuile m+1 est chargée dans le
+// second tampon local pendant le calcul sur la tuile m. Une seule barrière
+// par itération suffit : à l'itération m on lit cur et on écrit l'autre
+// tampon, dont les dernières lectures (itération m-1) sont terminées.
+__kernel void mmul_db(const int M, const int N, const int K,
+    __global float* d_A,
+    __global float* d_B,
+    __global float* d_C)
+{
+  __local float ds_M[2][TILE_WIDTH][TILE_WIDTH];
+  __local float ds_N[2][TILE_WIDTH][TILE_WIDTH];
+
+  int bx = get_group_id(0); int by = get_group_id(1);
+  int tx = get_local_id(0); int ty = get_local_id(1);
+
+  int Col = bx * TILE_WIDTH + tx;
+  int Row = by * TILE_WIDTH + ty;
+  int ntiles = (K + TILE_WIDTH - 1)/TILE_WIDTH;
+  float sp = 0;
+
+  // Première tuile
+  ds_M[0][ty][tx] = (Row < M && tx < K) ? d_A[Row*K + tx] : 0.0f;
+  ds_N[0][ty][tx] = (ty < K && Col < N) ? d_B[ty*N + Col] : 0.0f;
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for (int m = 0; m < ntiles; ++m) {
+    int cur = m & 1;
+
+    // Chargement de la tuile suivante dans l'autre tampon
+    if (m + 1 < ntiles) {
+      int kA = (m+1)*TILE_WIDTH + tx;
+      int kB = (m+1)*TILE_WIDTH + ty;
+      ds_M[cur^1][ty][tx] = (Row < M && kA < K) ? d_A[Row*K + kA] : 0.0f;
+      ds_N[cur^1][ty][tx] = (kB < K && Col < N) ? d_B[kB*N + Col] : 0.0f;
+    }
+
+    for (int k = 0; k < TILE_WIDTH; ++k)
+      sp += ds_M[cur][ty][k] * ds_N[cur][k][tx];
+
+    // La tuile suivante est complète, et plus personne ne lit celle-ci
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+
+  if (Row < M && Col < N)
+    d_C[Row*N+Col] = sp;
+}
+
+// Lit X[r][c..c+3] d'une matrice rows x cols par un seul vload4, ou
+// composante par composante (zéro hors de la matrice) en bord de matrice
+float4 load4(__global const float* X, int r, int c, int rows, int cols)
+{
+  if (r >= rows)
+    return (float4)(0.0f);
+  __global const float* p = X + r*cols + c;
+  if (c + 3 < cols)
+    return vload4(0, p);
+  float4 v = (float4)(0.0f);
+  if (c < cols)     v.x = p[0];
+  if (c + 1 < cols) v.y = p[1];
+  if (c + 2 < cols) v.z = p[2];
+  return v;
+}
+
+// Variante de mmul à accès vectoriels : un work-item calcule 4 éléments
+// consécutifs d'une ligne de C, et charge 4 éléments consécutifs de A et
+// de B par vload4 (groupes de TILE_WIDTH/4 x TILE_WIDTH work-items).
+// Les tuiles locales sont en float4, avec un float4 de plus par ligne :
+// les lignes restent alignées sur 16 octets (écritures et lectures
+// locales vectorielles), et les lectures ds_M[ty][k4] de lignes voisines
+// sont décalées de 4 bancs, au lieu d'un seul avec une colonne de
+// remplissage, ce qui laisse un conflit de bancs toutes les 8 lignes
+__kernel void mmul_vec(const int M, const int N, const int K,
+    __global const float* d_A,
+    __global const float* d_B,
+    __global float* d_C)
+{
+  __local float4 ds_M[TILE_WIDTH][TILE_WIDTH/4 + 1];
+  __local float4 ds_N[TILE_WIDTH][TILE_WIDTH/4 + 1];
+
+  int tx = get_local_id(0); int ty = get_local_id(1);
+  int Col = get_group_id(0) * TILE_WIDTH + 4*tx;
+  int Row = get_group_id(1) * TILE_WIDTH + ty;
+  float4 acc = (float4)(0.0f);
+
+  for (int m = 0; m < (K + TILE_WIDTH - 1)/TILE_WIDTH; ++m) {
+    ds_M[ty][tx] = load4(d_A, Row, m*TILE_WIDTH + 4*tx, M, K);
+    ds_N[ty][tx] = load4(d_B, m*TILE_WIDTH + ty, Col, K, N);
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // 4 éléments de la ligne de A par lecture
+    for (int k4 = 0; k4 < TILE_WIDTH/4; ++k4) {
+      float4 a = ds_M[ty][k4];
+      acc += a.x * ds_N[4*k4][tx];
+      acc += a.y * ds_N[4*k4 + 1][tx];
+      acc += a.z * ds_N[4*k4 + 2][tx];
+      acc += a.w * ds_N[4*k4 + 3][tx];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+
+  if (Row < M) {
+    __global float* c = d_C + Row*N + Col;
+    if (Col + 3 < N)
+      vstore4(acc, 0, c);
+    else {
+      if (Col < N)     c[0] = acc.x;
+      if (Col + 1 < N) c[1] = acc.y;
+      if (Col + 2 < N) c[2] = acc.z;
+    }
+  }
+}
+
+__kernel void mmul_reg(const int M, const int N, const int K,
+    __global float* d_A,
+    __global float* d_B,
+    __global float* d_C)
+{
+  // Tuiles de A (transposée) et de B en mémoire locale
+  __local float ds_A[TSK][TS];
+  __local float ds_B[TSK][TS];
+
+  // Le work-item (tx, ty) calcule les éléments (ty + wy*RTS, tx + wx*RTS)
+  // du bloc de C : les accès en mémoire locale et globale restent
+  // contigus d'un work-item à l'autre
+  int tx = get_local_id(0); int ty = get_local_id(1);
+  int offX = get_group_id(0) * TS;
+  int offY = get_group_id(1) * TS;
+  int tid = ty * RTS + tx;
+
+  // Accumulateurs et colonne de B gardés en registres
+  float acc[WPT][WPT];
+  float regB[WPT];
+  for (int wy = 0; wy < WPT; ++wy)
+    for (int wx = 0; wx < WPT; ++wx)
+      acc[wy][wx] = 0.0f;
+
+  for (int t = 0; t < (K + TSK - 1)/TSK; ++t) {
+    // Chargement collaboratif : TS*TSK éléments de chaque matrice
+    // répartis sur les RTS*RTS work-items du groupe, zéro hors des matrices
+    for (int l = 0; l < (TS*TSK)/(RTS*RTS); ++l) {
+      int id = l * RTS * RTS + tid;
+      int row = id / TSK; int col = id % TSK;
+      int gr = offY + row; int gk = t*TSK + col;
+      ds_A[col][row] = (gr < M && gk < K) ? d_A[gr*K + gk] : 0.0f;
+      row = id / TS; col = id % TS;
+      gk = t*TSK + row; int gc = offX + col;
+      ds_B[row][col] = (gk < K && gc < N) ? d_B[gk*N + gc] : 0.0f;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // WPT + WPT lectures locales pour WPT*WPT multiplications-additions
+    for (int k = 0; k < TSK; ++k) {
+      for (int wx = 0; wx < WPT; ++wx)
+        regB[wx] = ds_B[k][tx + wx*RTS];
+      for (int wy = 0; wy < WPT; ++wy) {
+        float a = ds_A[k][ty + wy*RTS];
+        for (int wx = 0; wx < WPT; ++wx)
+          acc[wy][wx] += a * regB[wx];
+      }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+
+  for (int wy = 0; wy < WPT; ++wy) {
+    int row = offY + ty + wy*RTS;
+    for (int wx = 0; wx < WPT; ++wx) {
+      int col = offX + tx + wx*RTS;
+      if (row < M && col < N)
+        d_C[row*N + col] = acc[wy][wx];
+    }
+  }
+}
+
+// Produit général C = alpha * op(A) * op(B) + beta * C, même découpage que
+// mmul_reg. op(X) vaut X si transX == 0 et sa transposée sinon ; op(A) est
+// M x K, op(B) est K x N, les matrices sont stockées par lignes avec les
+// dimensions principales lda, ldb et ldc.
+__kernel void gemm(const int transA, const int transB,
+    const int M, const int N, const int K,
+    const float alpha,
+    __global const float* d_A, const int lda,
+    __global const float* d_B, const int ldb,
+    const float beta,
+    __global float* d_C, const int ldc)
+{
+  __local float ds_A[TSK][TS];
+  __local float ds_B[TSK][TS];
+
+  int tx = get_local_id(0); int ty = get_local_id(1);
+  int offX = get_group_id(0) * TS;
+  int offY = get_group_id(1) * TS;
+  int tid = ty * RTS + tx;
+
+  float acc[WPT][WPT];
+  float regB[WPT];
+  for (int wy = 0; wy < WPT; ++wy)
+    for (int wx = 0; wx < WPT; ++wx)
+      acc[wy][wx] = 0.0f;
+
+  for (int t = 0; t < (K + TSK - 1)/TSK; ++t) {
+    // Les work-items consécutifs lisent des adresses consécutives quel que
+    // soit le sens de stockage : on parcourt la tuile selon la dimension
+    // contiguë en mémoire globale
+    for (int l = 0; l < (TS*TSK)/(RTS*RTS); ++l) {
+      int id = l * RTS * RTS + tid;
+      int i, k;
+      if (transA) { i = id % TS; k = id / TS; }
+      else        { i = id / TSK; k = id % TSK; }
+      int gi = offY + i; int gk = t*TSK + k;
+      float a = 0.0f;
+      if (gi < M && gk < K)
+        a = transA ? d_A[gk*lda + gi] : d_A[gi*lda + gk];
+      ds_A[k][i] = a;
+
+      int j;
+      if (transB) { j = id / TSK; k = id % TSK; }
+      else        { j = id % TS;  k = id / TS; }
+      int gj = offX + j; gk = t*TSK + k;
+      float b = 0.0f;
+      if (gk < K && gj < N)
+        b = transB ? d_B[gj*ldb + gk] : d_B[gk*ldb + gj];
+      ds_B[k][j] = b;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (int k = 0; k < TSK; ++k) {
+      for (int wx = 0; wx < WPT; ++wx)
+        regB[wx] = ds_B[k][tx + wx*RTS];
+      for (int wy = 0; wy < WPT; ++wy) {
+        float a = ds_A[k][ty + wy*RTS];
+        for (int wx = 0; wx < WPT; ++wx)
+          acc[wy][wx] += a * regB[wx];
+      }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+
+  // C n'est pas relu si beta est nul (il peut contenir n'importe quoi)
+  for (int wy = 0; wy < WPT; ++wy) {
+    int row = offY + ty + wy*RTS;
+    for (int wx = 0; wx < WPT; ++wx) {
+      int col = offX + tx + wx*RTS;
+      if (row < M && col < N) {
+        float c = alpha * acc[wy][wx];
+        if (beta != 0.0f)
+          c += beta * d_C[row*ldc + col];
+        d_C[row*ldc + col] = c;
+      }
+    }
+  }
+}
+
+// Produits par lots de petites matrices : C_b = alpha * op(A_b) * op(B_b)
+// + beta * C_b pour tout le lot en un seul NDRange, la troisième dimension
+// donnant b. Chaque groupe calcule une tuile BTILE x BTILE de C_b (des
+// tuiles plus petites que TS, les matrices n'ayant que 8 à 128 lignes).
+#ifndef BTILE
+#define BTILE 8
+#endif
+
+// Tuile (get_group_id(0), get_group_id(1)) d'un produit, mêmes conventions
+// que gemm ; ds_A et ds_B sont les tuiles locales déclarées par le noyau
+void gemm_batch_tile(const int transA, const int transB,
+    const int M, const int N, const int K,
+    const float alpha,
+    __global const float* d_A, const int lda,
+    __global const float* d_B, const int ldb,
+    const float beta,
+    __global float* d_C, const int ldc,
+    __local float ds_A[BTILE][BTILE],
+    __local float ds_B[BTILE][BTILE])
+{
+  int tx = get_local_id(0); int ty = get_local_id(1);
+  int col = get_group_id(0) * BTILE + tx;
+  int row = get_group_id(1) * BTILE + ty;
+  float acc = 0.0f;
+
+  for (int t = 0; t < (K + BTILE - 1)/BTILE; ++t) {
+    int k = t*BTILE + tx;
+    ds_A[ty][tx] = (row < M && k < K) ? (transA ? d_A[k*lda + row] : d_A[row*lda + k]) : 0.0f;
+    k = t*BTILE + ty;
+    ds_B[ty][tx] = (k < K && col < N) ? (transB ? d_B[col*ldb + k] : d_B[k*ldb + col]) : 0.0f;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (int kk = 0; kk < BTILE; ++kk)
+      acc += ds_A[ty][kk] * ds_B[kk][tx];
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+
+  if (row < M && col < N) {
+    float c = alpha * acc;
+    if (beta != 0.0f)
+      c += beta * d_C[row*ldc + col];
+    d_C[row*ldc + col] = c;
+  }
+}
+
+// Forme à pas constant : X_b commence à X + b*strideX
+__kernel void gemm_batched_strided(const int transA, const int transB,
+    const int M, const int N, const int K,
+    const float alpha,
+    __global const float* d_A, const int lda, const ulong strideA,
+    __global const float* d_B, const int ldb, const ulong strideB,
+    const float beta,
+    __global float* d_C, const int ldc, const ulong strideC)
+{
+  __local float ds_A[BTILE][BTILE];
+  __local float ds_B[BTILE][BTILE];
+
+  size_t b = get_global_id(2);
+  gemm_batch_tile(transA, transB, M, N, K, alpha,
+                  d_A + b*strideA, lda, d_B + b*strideB, ldb,
+                  beta, d_C + b*strideC, ldc, ds_A, ds_B);
+}
+
+// Forme à tableaux : OpenCL 1.2 n'ayant pas de pointeurs partagés, X_b
+// commence à X + offX[b] (en floats) dans le tampon de l'opérande
+__kernel void gemm_batched(const int transA, const int transB,
+    const int M, const int N, const int K,
+    const float alpha,
+    __global const float* d_A, const int lda, __global const ulong* offA,
+    __global const float* d_B, const int ldb, __global const ulong* offB,
+    const float beta,
+    __global float* d_C, const int ldc, __global const ulong* offC)
+{
+  __local float ds_A[BTILE][BTILE];
+  __local float ds_B[BTILE][BTILE];
+
+  size_t b = get_global_id(2);
+  gemm_batch_tile(transA, transB, M, N, K, alpha,
+                  d_A + offA[b], lda, d_B + offB[b], ldb,
+                  beta, d_C + offC[b], ldc, ds_A, ds_B);
 }
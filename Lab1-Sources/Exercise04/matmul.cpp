@@ -10,17 +10,29 @@
 **           A and B are set to constant matrices so we
 **           can make a quick test of the multiplication.
 **
-**  USAGE:   The matrices are constant matrices, square and the order is
-**           set as a constant, ORDER (see mult.h).
+**  USAGE:   The matrices are constant matrices, square, of order ORDER
+**           (see matmul.hpp) unless --size gives one or more orders,
+**           e.g. --size 256:4096 for a sweep. Each variant is run
+**           WARMUP times untimed then COUNT times (--warmup and
+**           --iterations), and summarised by util::Benchmark.
 **
 ** ----------------------------------------------------------------
 */
 
 #include "matmul.hpp"
 #include "matrix_lib.hpp"
+#include "matrix_kernels.hpp"
+#include "clgemm.hpp"
+#include "multigemm.hpp"
+#include "autotune.hpp"
+#include "program_cache.hpp"
 #include "util.hpp"
 #include <err_code.h>
 #include "device_picker.hpp"
+#include "profiling.hpp"
+#include "benchmark.hpp"
+
+#include <limits>
 
 int main(int argc, char *argv[])
 {
@@ -28,136 +40,565 @@ int main(int argc, char *argv[])
     int N;    // A[N][N], B[N][N], C[N][N]
     int size; // Number of elements in each matrix
 
-    double start_time; // Starting time
-    double run_time;   // Timing
     util::Timer timer; // Timing
+    util::EventTimes times; // Device times of the last run of a kernel
+    double wall_time;       // and its host wall clock time
 
-    N = ORDER;
-    size = N * N;
-
-    std::vector<float> h_A(size); // Host memory for Matrix A
-    std::vector<float> h_B(size); // Host memory for Matrix B
-    std::vector<float> h_C(size); // Host memory for Matrix C
+    std::vector<float> h_A; // Host memory for Matrix A
+    std::vector<float> h_B; // Host memory for Matrix B
+    std::vector<float> h_C; // Host memory for Matrix C
 
     cl::Buffer d_a, d_b, d_c; // Matrices in device memory
 
     // ------------------------------------------------------------------
-    // Create a context and queue
+    // Options: --size, --iterations, --warmup, --variant (the kernel:
+    // _mmul|mmul|mmul_db|mmul_vec|mmul_reg|gemm|all, or multi for every
+    // device at once, or batched for batches of small products) and
+    // --output are handled by parseArguments, together with the device
+    // and the driver specific ones registered below.
     // ------------------------------------------------------------------
 
+    cl_uint deviceIndex = 2;
+    RunOptions options(ORDER, WARMUP, COUNT);
+    options.variant = "all";
+
+    std::string hostMode = "blocked", simd = "auto";
+    std::vector<size_t> multiDevices;
+    bool tune = false;
+    size_t batchCount = BATCH, threads = 0;
+    options.addChoice("--host", "MODE", "Host matmul: seq, blocked or none", &hostMode, "seq|blocked|none");
+    options.addNumber("--threads", "N", "Threads of the host matmul", &threads, 1, 1024);
+    options.addChoice("--simd", "NAME", "Micro-kernel of the host matmul: auto, avx512, avx2 or scalar",
+                      &simd, "auto|avx512|avx2|scalar");
+    options.addList("--devices", "I,J,...", "Devices of the multi variant (default all)", &multiDevices);
+    options.addFlag("--tune", "Tune the tiles of the mmul kernels, saved for the next runs", &tune);
+    options.addNumber("--batch", "COUNT", "Products per batch of the batched variant", &batchCount, 1, 1 << 20);
     try
     {
+        parseArguments(argc, argv, &deviceIndex, &options);
+    }
+    catch (cl::Error err)
+    {
+        std::cerr << "ERROR: " << err.what() << "(" << err_code(err.err()) << ")" << std::endl;
+        return EXIT_FAILURE;
+    }
 
-        cl_uint deviceIndex = 2;
-        parseArguments(argc, argv, &deviceIndex);
-
-        // Get list of devices
-        std::vector<cl::Device> devices;
-        unsigned numDevices = getDeviceList(devices);
+    // batched: orders 8 to 128 unless --size is given
+    if (options.variant == "batched" && !options.sizeGiven)
+        parseSizes("8:128", &options.sizes);
+    int batch = (int) batchCount;
+    if (threads > 0)
+        set_host_threads((int) threads);
+    if (!set_gemm_ukernel(simd.c_str()))
+    {
+        std::cout << "SIMD kernel " << simd << " not supported on this CPU\n";
+        return EXIT_FAILURE;
+    }
 
-        // Check device index in range
-        if (deviceIndex >= numDevices)
-        {
-            std::cout << "Invalid device index (try '--list')\n";
-            return EXIT_FAILURE;
-        }
+    // Every variant: warmup untimed runs, then iterations timed ones
+    util::Benchmark bench(options.warmup, options.iterations);
 
-        cl::Device device = devices[deviceIndex];
+    // The product of the constant matrices is checked after the last run
+    util::Benchmark::Check check = [&]() {
+        float errsq = error(N, h_C);
+        return !(std::isnan(errsq) || errsq > TOL);
+    };
 
-        std::string name;
-        getDeviceName(device, name);
-        std::cout << "\nUsing OpenCL device: " << name << "\n";
-
-        std::vector<cl::Device> chosen_device;
-        chosen_device.push_back(device);
-        cl::Context context(chosen_device);
-        cl::CommandQueue queue(context, device);
+    // ------------------------------------------------------------------
+    // Run the host matmul (also the fallback when no device is usable)
+    // ------------------------------------------------------------------
 
-        // ------------------------------------------------------------------
-        // Run sequential matmul
-        // ------------------------------------------------------------------
+    for (size_t s = 0; s < options.sizes.size() && hostMode != "none" && options.variant != "batched"; s++)
+    {
+        N = options.sizes[s];
+        size = N * N;
+        h_A.resize(size);
+        h_B.resize(size);
+        h_C.resize(size);
 
         initmat(N, h_A, h_B, h_C);
 
-        timer.reset();
+        if (hostMode == "seq")
+            std::cout << "\n===== Sequential, matrix mult (dot prod), order " << N << " on host CPU ======" << std::endl;
+        else
+            std::cout << "\n===== Blocked, matrix mult, order " << N << " on host CPU (" << get_host_threads() << " threads, "
+                      << get_gemm_ukernel().name << " kernel) ======" << std::endl;
 
-        std::cout << "\n===== Sequential, matrix mult (dot prod), order %d on host CPU ======" << N << std::endl;
-        for (int i = 0; i < COUNT; i++)
-        {
+        std::string variant = hostMode == "seq" ? "host_seq" : std::string("host_blocked_") + get_gemm_ukernel().name;
+        bench.add(variant, N, 2.0 * N * N * N * 1e-9, "GFLOPS", [&]() {
             zero_mat(N, h_C);
 
-            start_time = static_cast<double>(timer.getTimeMilliseconds()) / 1000.0;
+            timer.reset();
 
-            seq_mat_mul_sdot(N, h_A, h_B, h_C);
+            if (hostMode == "seq")
+                seq_mat_mul_sdot(N, h_A, h_B, h_C);
+            else
+                blocked_mat_mul(N, h_A, h_B, h_C);
 
-            run_time = (static_cast<double>(timer.getTimeMilliseconds()) / 1000.0) - start_time;
-            results(N, h_C, run_time);
-        }
+            return static_cast<double>(timer.getTimeMicroseconds()) / 1e6;
+        }, check);
+        bench.run();
+    }
 
-        // ------------------------------------------------------------------
-        // Setup the buffers, initialize matrices, and write them into global memory
-        // ------------------------------------------------------------------
+    // ------------------------------------------------------------------
+    // Batched matmul: batch products of order N, on the host then in a
+    // single launch on the device. Matrix b of A and of B is constant,
+    // of value AVAL + b%7 and BVAL + b%5, so that a product computed
+    // from the wrong matrices fails the check. The pointer-array forms
+    // take A in reverse order, B rotated by one and C rotated by two,
+    // so that a product that ignored any of the three arrays would too.
+    // ------------------------------------------------------------------
 
-        //  Reset A, B and C matrices (just to play it safe)
-        initmat(N, h_A, h_B, h_C);
+    if (options.variant == "batched")
+    {
+        std::vector<const float*> ptrA, ptrB;
+        std::vector<float*> ptrC;
+        std::vector<cl_ulong> offA, offB, offC;
+
+        // Fills A, B and the offsets (in floats) of the pointer-array forms
+        auto fill_batch = [&]() {
+            h_A.resize((size_t) size * batch);
+            h_B.resize((size_t) size * batch);
+            h_C.resize((size_t) size * batch);
+            offA.resize(batch);
+            offB.resize(batch);
+            offC.resize(batch);
+            for (int b = 0; b < batch; b++)
+            {
+                std::fill(h_A.begin() + (size_t) b * size, h_A.begin() + (size_t) (b + 1) * size, AVAL + b % 7);
+                std::fill(h_B.begin() + (size_t) b * size, h_B.begin() + (size_t) (b + 1) * size, BVAL + b % 5);
+                offA[b] = (cl_ulong) (batch - 1 - b) * size;
+                offB[b] = (cl_ulong) ((b + 1) % batch) * size;
+                offC[b] = (cl_ulong) ((b + 2) % batch) * size;
+            }
+        };
+
+        // Product b reads A and B at b*size (strided forms) or at
+        // offA[b] and offB[b], and writes C at b*size or offC[b]
+        auto batch_check = [&](bool offsets) -> util::Benchmark::Check {
+            return [&, offsets]() {
+                for (int b = 0; b < batch; b++)
+                {
+                    size_t a = offsets ? offA[b] / size : b;
+                    size_t k = offsets ? offB[b] / size : b;
+                    size_t c = offsets ? offC[b] : (size_t) b * size;
+                    float expected = N * (AVAL + a % 7) * (BVAL + k % 5);
+                    for (int i = 0; i < N * N; i++)
+                    {
+                        float err = (h_C[c + i] - expected) / expected;
+                        if (std::isnan(err) || err * err > TOL)
+                            return false;
+                    }
+                }
+                return true;
+            };
+        };
+
+        for (size_t s = 0; s < options.sizes.size(); s++)
+        {
+            N = options.sizes[s];
+            size = N * N;
+            fill_batch();
+            ptrA.resize(batch);
+            ptrB.resize(batch);
+            ptrC.resize(batch);
+            for (int b = 0; b < batch; b++)
+            {
+                ptrA[b] = &h_A[offA[b]];
+                ptrB[b] = &h_B[offB[b]];
+                ptrC[b] = &h_C[offC[b]];
+            }
+            double gflop = 2.0 * N * N * N * batch * 1e-9;
+
+            std::cout << "\n===== Batched, " << batch << " matrix mults of order " << N << " on host CPU ("
+                      << get_host_threads() << " threads) ======" << std::endl;
+
+            bench.add("host_batched_strided", N, gflop, "GFLOPS", [&]() {
+                std::fill(h_C.begin(), h_C.end(), 0.0f);
+                timer.reset();
+                gemm_batched_strided('N', 'N', N, N, N, 1.0f, &h_A[0], N, size, &h_B[0], N, size,
+                                     0.0f, &h_C[0], N, size, batch);
+                return static_cast<double>(timer.getTimeMicroseconds()) / 1e6;
+            }, batch_check(false));
+            bench.add("host_batched", N, gflop, "GFLOPS", [&, ptrA, ptrB, ptrC]() {
+                std::fill(h_C.begin(), h_C.end(), 0.0f);
+                timer.reset();
+                gemm_batched('N', 'N', N, N, N, 1.0f, &ptrA[0], N, &ptrB[0], N,
+                             0.0f, &ptrC[0], N, batch);
+                return static_cast<double>(timer.getTimeMicroseconds()) / 1e6;
+            }, batch_check(true));
+            bench.run();
+        }
 
-        d_a = cl::Buffer(context, h_A.begin(), h_A.end(), true);
+        try
+        {
+            // Get list of devices
+            std::vector<cl::Device> devices;
+            unsigned numDevices = getDeviceList(devices);
+
+            // Check device index in range
+            if (deviceIndex >= numDevices)
+            {
+                std::cout << "Invalid device index (try '--list')\n";
+                bench.print();
+                return EXIT_FAILURE;
+            }
+
+            cl::Device device = devices[deviceIndex];
+
+            std::string name;
+            getDeviceName(device, name);
+            std::cout << "\nUsing OpenCL device: " << name << "\n";
+
+            std::vector<cl::Device> chosen_device;
+            chosen_device.push_back(device);
+            cl::Context context(chosen_device);
+            cl::CommandQueue queue = util::makeQueue(context, device);
+            CLGemm clgemm(context, device);
+
+            // C starts as NaN for each kernel, as in the loop over kernels below
+            auto device_check = [&](bool offsets) -> util::Benchmark::Check {
+                util::Benchmark::Check check = batch_check(offsets);
+                return [&, check]() {
+                    cl::copy(queue, d_c, h_C.begin(), h_C.end());
+                    return check();
+                };
+            };
+            auto clear_c = [&]() {
+                queue.enqueueFillBuffer(d_c, std::numeric_limits<float>::quiet_NaN(), 0, sizeof(float) * h_C.size());
+            };
+
+            for (size_t s = 0; s < options.sizes.size(); s++)
+            {
+                N = options.sizes[s];
+                size = N * N;
+                fill_batch();
+                double gflop = 2.0 * N * N * N * batch * 1e-9;
+
+                d_a = cl::Buffer(context, h_A.begin(), h_A.end(), true);
+                d_b = cl::Buffer(context, h_B.begin(), h_B.end(), true);
+                d_c = cl::Buffer(context, CL_MEM_READ_WRITE, sizeof(float) * h_C.size());
+                cl::Buffer d_offA(context, offA.begin(), offA.end(), true);
+                cl::Buffer d_offB(context, offB.begin(), offB.end(), true);
+                cl::Buffer d_offC(context, offC.begin(), offC.end(), true);
+
+                std::cout << "\n===== OpenCL, " << batch << " matrix mults of order " << N << ", "
+                          << BTILE << "x" << BTILE << " tiles ======" << std::endl;
+
+                clear_c();
+                bench.add("batched_strided", N, gflop, "GFLOPS", [&]() {
+                    cl::Event event;
+                    clgemm.batchedStrided(queue, 'N', 'N', N, N, N, 1.0f, d_a, N, size, d_b, N, size,
+                                          0.0f, d_c, N, size, batch, 0, &event);
+                    queue.finish();
+                    return util::getEventTimes(event).execution();
+                }, device_check(false));
+                bench.run();
+
+                clear_c();
+                bench.add("batched", N, gflop, "GFLOPS", [&, d_offA, d_offB, d_offC]() {
+                    cl::Event event;
+                    clgemm.batched(queue, 'N', 'N', N, N, N, 1.0f, d_a, N, d_offA, d_b, N, d_offB,
+                                   0.0f, d_c, N, d_offC, batch, &event);
+                    queue.finish();
+                    return util::getEventTimes(event).execution();
+                }, device_check(true));
+                bench.run();
+
+                clear_c();
+                // One launch per product, for comparison: from the start of
+                // the first to the end of the last, launch overheads included
+                bench.add("batched_loop", N, gflop, "GFLOPS", [&]() {
+                    cl::Event first, last;
+                    for (int b = 0; b < batch; b++)
+                        clgemm.batchedStrided(queue, 'N', 'N', N, N, N, 1.0f, d_a, N, size, d_b, N, size,
+                                              0.0f, d_c, N, size, 1, b, b == 0 ? &first : &last);
+                    queue.finish();
+                    return util::getEventTimes(first, batch > 1 ? last : first).execution();
+                }, device_check(false));
+                bench.run();
+            }
+        }
+        catch (cl::Error err)
+        {
+            std::cout << "Exception\n";
+            std::cerr << "ERROR: "
+                      << err.what()
+                      << "("
+                      << err_code(err.err())
+                      << ")"
+                      << std::endl;
+        }
 
-        d_b = cl::Buffer(context, h_B.begin(), h_B.end(), true);
+        bench.print();
+        if (!options.output.empty() && !bench.save(options.output))
+            std::cout << "Cannot write " << options.output << std::endl;
 
-        d_c = cl::Buffer(context, CL_MEM_WRITE_ONLY, sizeof(float) * size);
+        return EXIT_SUCCESS;
+    }
 
-        // ------------------------------------------------------------------
-        // OpenCL matrix multiplication ... Naive
-        // ------------------------------------------------------------------
+    // ------------------------------------------------------------------
+    // Multi-device matmul: row panels of C on every device at once
+    // ------------------------------------------------------------------
 
-        timer.reset();
-        // Load in kernel source, creating a program object for the context
-        cl::Program program(context, util::loadProgram("matmul.cl"), true);
+    if (options.variant == "multi")
+    {
+        try
+        {
+            std::vector<cl::Device> devices, chosen;
+            unsigned numDevices = getDeviceList(devices);
+            for (size_t i = 0; i < multiDevices.size(); i++)
+                if (multiDevices[i] >= numDevices)
+                {
+                    std::cout << "Invalid device index " << multiDevices[i] << " (try '--list')\n";
+                    return EXIT_FAILURE;
+                }
+            for (size_t d = 0; d < numDevices; d++)
+                if (multiDevices.empty() || std::count(multiDevices.begin(), multiDevices.end(), d))
+                    chosen.push_back(devices[d]);
+            if (chosen.empty())
+            {
+                std::cout << "No OpenCL device\n";
+                return EXIT_FAILURE;
+            }
+
+            // The warmup runs also measure the devices for the split
+            MultiGemm multigemm(chosen);
+
+            for (size_t s = 0; s < options.sizes.size(); s++)
+            {
+                N = options.sizes[s];
+                size = N * N;
+                h_A.resize(size);
+                h_B.resize(size);
+                h_C.resize(size);
+                initmat(N, h_A, h_B, h_C);
+
+                std::cout << "\n===== OpenCL, matrix mult, row panels of C on " << multigemm.deviceCount()
+                          << " devices, order " << N << " ======" << std::endl;
+
+                bench.add("multi", N, 2.0 * N * N * N * 1e-9, "GFLOPS", [&]() {
+                    zero_mat(N, h_C);
+
+                    timer.reset();
+
+                    multigemm(N, N, N, h_A.data(), h_B.data(), h_C.data());
+
+                    return static_cast<double>(timer.getTimeMicroseconds()) / 1e6;
+                }, check);
+                bench.run();
+
+                for (size_t d = 0; d < multigemm.deviceCount(); d++)
+                    printf(" %-40s %6d rows  %8.2f GFLOPS\n", multigemm.name(d).c_str(),
+                           multigemm.rows(d), multigemm.gflops(d));
+            }
+        }
+        catch (cl::Error err)
+        {
+            std::cout << "Exception\n";
+            std::cerr << "ERROR: "
+                      << err.what()
+                      << "("
+                      << err_code(err.err())
+                      << ")"
+                      << std::endl;
+        }
 
-        // Create the compute kernel from the program
-        cl::Kernel kernel_mul = cl::Kernel(program, "mmul");
+        bench.print();
+        if (!options.output.empty() && !bench.save(options.output))
+            std::cout << "Cannot write " << options.output << std::endl;
 
-        // Display max group size for execution
-        std::cout << "\nWork Group Size " << kernel_mul.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device) << std::endl;
-        std::cout << "Work Group Memory size " << kernel_mul.getWorkGroupInfo<CL_KERNEL_LOCAL_MEM_SIZE>(device) << std::endl;
+        return EXIT_SUCCESS;
+    }
 
-        std::cout << "\n===== OpenCL, matrix mult, C(i,j) per work item, order %d ======" << N << std::endl;
+    // ------------------------------------------------------------------
+    // Create a context and queue
+    // ------------------------------------------------------------------
 
-        // Do the multiplication COUNT times
-        for (int i = 0; i < COUNT; i++)
-        {
-            // Set output matrix to 0
-            zero_mat(N, h_C);
+    try
+    {
 
-            // Initialize arguments of kernel
-            kernel_mul.setArg(0, N);
-            kernel_mul.setArg(1, d_a);
-            kernel_mul.setArg(2, d_b);
-            kernel_mul.setArg(3, d_c);
+        // Get list of devices
+        std::vector<cl::Device> devices;
+        unsigned numDevices = getDeviceList(devices);
 
-            // Set workspace and workgroup topologies
-            cl::NDRange global(N, N);
-            cl::NDRange local(16, 16);
+        // Check device index in range
+        if (deviceIndex >= numDevices)
+        {
+            std::cout << "Invalid device index (try '--list')\n";
+            bench.print();
+            return EXIT_FAILURE;
+        }
 
-            start_time = static_cast<double>(timer.getTimeMilliseconds()) / 1000.0;
+        cl::Device device = devices[deviceIndex];
 
-            // Execute the kernel over the entire range of C matrix elements ... computing
-            // a dot product for each element of the product matrix.  The local work
-            // group size is set to NULL ... so I'm telling the OpenCL runtime to
-            // figure out a local work group size for me.
+        std::string name;
+        getDeviceName(device, name);
+        std::cout << "\nUsing OpenCL device: " << name << "\n";
 
-            queue.enqueueNDRangeKernel(kernel_mul, cl::NullRange, global, local);
+        std::vector<cl::Device> chosen_device;
+        chosen_device.push_back(device);
+        cl::Context context(chosen_device);
+        // Profiling queue: kernel times come from the device events
+        cl::CommandQueue queue = util::makeQueue(context, device);
 
-            queue.finish();
+        // Load in kernel source, creating a program object for the context,
+        // and build it with the tile sizes of matmul.hpp
+        CLGemm clgemm(context, device);
+        cl::Program program = clgemm.program();
 
-            run_time = (static_cast<double>(timer.getTimeMilliseconds()) / 1000.0) - start_time;
+        std::vector<std::string> kernels;
+        if (options.variant == "all")
+        {
+            kernels.push_back("_mmul");
+            kernels.push_back("mmul");
+            kernels.push_back("mmul_db");
+            kernels.push_back("mmul_vec");
+            kernels.push_back("mmul_reg");
+            kernels.push_back("gemm");
+        }
+        else
+            kernels.push_back(options.variant);
 
+        // Device check: copy C back, then compare
+        util::Benchmark::Check device_check = [&]() {
             cl::copy(queue, d_c, h_C.begin(), h_C.end());
+            return check();
+        };
 
-            results(N, h_C, run_time);
-
-        } // end for loop
+        for (size_t s = 0; s < options.sizes.size(); s++)
+        {
+            N = options.sizes[s];
+            size = N * N;
+            h_A.resize(size);
+            h_B.resize(size);
+            h_C.resize(size);
+            double gflop = 2.0 * N * N * N * 1e-9;
+
+            // ------------------------------------------------------------------
+            // Setup the buffers, initialize matrices, and write them into global memory
+            // ------------------------------------------------------------------
+
+            //  Reset A, B and C matrices (just to play it safe)
+            initmat(N, h_A, h_B, h_C);
+
+            d_a = cl::Buffer(context, h_A.begin(), h_A.end(), true);
+
+            d_b = cl::Buffer(context, h_B.begin(), h_B.end(), true);
+
+            d_c = cl::Buffer(context, CL_MEM_WRITE_ONLY, sizeof(float) * size);
+
+            // ------------------------------------------------------------------
+            // OpenCL matrix multiplication, one benchmark per selected kernel
+            // ------------------------------------------------------------------
+
+            for (size_t v = 0; v < kernels.size(); v++)
+            {
+                // The tiled kernels take their tiles from the tuning file
+                // (measured first with --tune), or else from matmul.hpp
+                MmulConfig config(kernels[v]);
+                bool tunable = kernels[v] != "_mmul" && kernels[v] != "gemm";
+                if (tunable && tune)
+                {
+                    std::cout << "\n===== Tuning " << kernels[v] << ", order " << N << " ======" << std::endl;
+                    config = autotune_mmul(context, device, queue, kernels[v], N, d_a, d_b, d_c, device_check, bench);
+                    std::cout << "Best: " << config.describe() << ", " << config.gflops << " GFLOPS" << std::endl;
+                    if (config.gflops > 0.0 && !save_mmul_tuning(device, N, config))
+                        std::cout << "Cannot save the tuning" << std::endl;
+                }
+                else if (tunable && load_mmul_tuning(device, kernels[v], N, &config))
+                    std::cout << "\nTuned tiles for order " << mmul_size_class(N) << ": " << config.describe() << std::endl;
+
+                // Create the compute kernel from the program
+                cl::Program kernel_program = program;
+                if (tunable)
+                    kernel_program = util::buildProgram(context, device, util::loadProgram("matmul.cl"),
+                                                        config.buildOptions());
+                cl::Kernel kernel_mul = cl::Kernel(kernel_program, kernels[v].c_str());
+
+                // Set workspace and workgroup topologies
+                cl::NDRange global(N, N);
+                cl::NDRange local = cl::NullRange;
+                if (kernels[v] == "mmul")
+                {
+                    std::cout << "\n===== OpenCL, matrix mult, C(i,j) per work item, "
+                              << config.tileWidth << "x" << config.tileWidth << " local tiles, order " << N << " ======" << std::endl;
+                    global = config.global(N);
+                    local = config.local();
+                }
+                else if (kernels[v] == "mmul_db")
+                {
+                    std::cout << "\n===== OpenCL, matrix mult, C(i,j) per work item, "
+                              << config.tileWidth << "x" << config.tileWidth << " double buffered local tiles, order " << N << " ======" << std::endl;
+                    global = config.global(N);
+                    local = config.local();
+                }
+                else if (kernels[v] == "mmul_vec")
+                {
+                    std::cout << "\n===== OpenCL, matrix mult, 4 elements of C per work item (float4), "
+                              << config.tileWidth << "x" << config.tileWidth << " padded local tiles, order " << N << " ======" << std::endl;
+                    global = config.global(N);
+                    local = config.local();
+                }
+                else if (kernels[v] == "mmul_reg")
+                {
+                    std::cout << "\n===== OpenCL, matrix mult, " << config.wpt << "x" << config.wpt << " block of C per work item, "
+                              << config.ts << "x" << config.ts << " tiles, order " << N << " ======" << std::endl;
+                    global = config.global(N);
+                    local = config.local();
+                }
+                else if (kernels[v] == "gemm")
+                    std::cout << "\n===== OpenCL, gemm (C = alpha*A*B + beta*C), order " << N << " ======" << std::endl;
+                else
+                    std::cout << "\n===== OpenCL, matrix mult, C(i,j) per work item, no tiling, order " << N << " ======" << std::endl;
+
+                // Display max group size for execution
+                std::cout << "Work Group Size " << kernel_mul.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device) << std::endl;
+                std::cout << "Work Group Memory size " << kernel_mul.getWorkGroupInfo<CL_KERNEL_LOCAL_MEM_SIZE>(device) << std::endl;
+
+                // Initialize arguments of kernel (gemm sets its own)
+                if (kernels[v] != "gemm")
+                {
+                    kernel_mul.setArg(0, N);
+                    kernel_mul.setArg(1, N);
+                    kernel_mul.setArg(2, N);
+                    kernel_mul.setArg(3, d_a);
+                    kernel_mul.setArg(4, d_b);
+                    kernel_mul.setArg(5, d_c);
+                }
+
+                // C starts as NaN for each kernel, so that one writing
+                // nothing cannot pass on the results of the previous one
+                queue.enqueueFillBuffer(d_c, std::numeric_limits<float>::quiet_NaN(), 0, sizeof(float) * size);
+
+                bool is_gemm = kernels[v] == "gemm";
+                wall_time = 0.0;
+
+                bench.add(kernels[v], N, gflop, "GFLOPS", [&, is_gemm, kernel_mul, global, local]() {
+                    timer.reset();
+
+                    // Execute the kernel over the entire range of C matrix elements
+                    cl::Event event;
+                    if (is_gemm)
+                        clgemm(queue, 'N', 'N', N, N, N, 1.0f, d_a, N, d_b, N, 0.0f, d_c, N, &event);
+                    else
+                        queue.enqueueNDRangeKernel(kernel_mul, cl::NullRange, global, local, NULL, &event);
+
+                    queue.finish();
+
+                    wall_time = static_cast<double>(timer.getTimeMicroseconds()) / 1e6;
+
+                    // Rate from the device execution time, launch overhead apart
+                    times = util::getEventTimes(event);
+                    return times.execution();
+                }, device_check);
+                bench.run();
+
+                util::printEventTimes("last run", times);
+                printf(" host wall clock %.3f ms, launch overhead %.3f ms\n",
+                       wall_time * 1e3, times.overhead() * 1e3);
+            }
+        }
     }
     catch (cl::Error err)
     {
@@ -170,5 +611,9 @@ int main(int argc, char *argv[])
                   << std::endl;
     }
 
+    bench.print();
+    if (!options.output.empty() && !bench.save(options.output))
+        std::cout << "Cannot write " << options.output << std::endl;
+
     return EXIT_SUCCESS;
 }
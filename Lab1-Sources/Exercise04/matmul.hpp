@@ -28,13 +28,22 @@ extern double wtime();   // returns time since some fixed past point (wtime.c)
 // ----------------------------------------------------------------
 //  Constants
 // ----------------------------------------------------------------
-#define ORDER    1024    // Order of the square matrices A, B, and C
+#define ORDER    1024    // Default order of the square matrices (--size)
 #define AVAL     3.0     // A elements are constant and equal to AVAL
 #define BVAL     5.0     // B elements are constant and equal to BVAL
 #define TOL      (0.001) // tolerance used in floating point comparisons
 #define DIM      2       // Max dim for NDRange
-#define COUNT    1       // number of times to do each multiplication
+#define COUNT    10      // timed runs of each multiplication (--iterations)
+#define WARMUP   2       // untimed runs before them (--warmup)
+#define BATCH    1000    // products of the batched variant (--batch)
 #define SUCCESS  1
 #define FAILURE  0
 
+// Tile sizes of the OpenCL kernels, passed to matmul.cl as -D options
+#define TILE_WIDTH 16    // mmul: TILE_WIDTH x TILE_WIDTH work-groups
+#define TS         64    // mmul_reg: TS x TS block of C per work-group
+#define WPT        4     // mmul_reg: WPT x WPT block of C per work-item
+#define TSK        16    // mmul_reg: depth of the local tiles
+#define BTILE      8     // gemm_batched*: BTILE x BTILE tiles of each small product
+
 #endif
@@ -0,0 +1,215 @@
+/* ----------------------------------------------------------------
+**
+**  PROGRAM: Micro-kernels for the blocked host GEMM
+**
+**  PURPOSE: Register blocked C += A * B on packed micro-panels,
+**           in plain C++ and with AVX2/FMA and AVX-512 intrinsics.
+**           The vector versions are compiled with a per function
+**           target attribute and only used when the CPU reports
+**           the matching features at run time.
+**
+** ----------------------------------------------------------------
+*/
+
+#include "matrix_kernels.hpp"
+
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GEMM_X86_SIMD
+#include <immintrin.h>
+#endif
+
+// Adds the mr x nr valid part of the register tile ab (row stride NR) to C
+static inline void add_tile(const float* ab, int NR, float* C, int ldc, int mr, int nr)
+{
+    for (int i = 0; i < mr; i++)
+        for (int j = 0; j < nr; j++)
+            C[i*ldc+j] += ab[i*NR+j];
+}
+
+// ----------------------------------------------------------------
+//
+//  Portable 6x16 kernel
+//
+// ----------------------------------------------------------------
+static void ukernel_scalar_6x16(int kc, const float* a, const float* b,
+                                float* C, int ldc, int mr, int nr)
+{
+    float ab[6 * 16];
+    for (int i = 0; i < 6 * 16; i++)
+        ab[i] = 0.0f;
+
+    for (int p = 0; p < kc; p++) {
+        for (int i = 0; i < 6; i++) {
+            float ai = a[i];
+            for (int j = 0; j < 16; j++)
+                ab[i*16+j] += ai * b[j];
+        }
+        a += 6;
+        b += 16;
+    }
+
+    add_tile(ab, 16, C, ldc, mr, nr);
+}
+
+#ifdef GEMM_X86_SIMD
+
+// ----------------------------------------------------------------
+//
+//  AVX2 + FMA 6x16 kernel: 12 ymm accumulators, 2 loads of b and
+//  6 broadcasts of a for 12 FMA per step
+//
+// ----------------------------------------------------------------
+__attribute__((target("avx2,fma")))
+static void ukernel_avx2_6x16(int kc, const float* a, const float* b,
+                              float* C, int ldc, int mr, int nr)
+{
+    __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+    __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+    __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+    __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+    __m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+    __m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+
+    for (int p = 0; p < kc; p++) {
+        __m256 b0 = _mm256_loadu_ps(b);
+        __m256 b1 = _mm256_loadu_ps(b + 8);
+        __m256 ai;
+
+        ai = _mm256_broadcast_ss(a + 0);
+        c00 = _mm256_fmadd_ps(ai, b0, c00); c01 = _mm256_fmadd_ps(ai, b1, c01);
+        ai = _mm256_broadcast_ss(a + 1);
+        c10 = _mm256_fmadd_ps(ai, b0, c10); c11 = _mm256_fmadd_ps(ai, b1, c11);
+        ai = _mm256_broadcast_ss(a + 2);
+        c20 = _mm256_fmadd_ps(ai, b0, c20); c21 = _mm256_fmadd_ps(ai, b1, c21);
+        ai = _mm256_broadcast_ss(a + 3);
+        c30 = _mm256_fmadd_ps(ai, b0, c30); c31 = _mm256_fmadd_ps(ai, b1, c31);
+        ai = _mm256_broadcast_ss(a + 4);
+        c40 = _mm256_fmadd_ps(ai, b0, c40); c41 = _mm256_fmadd_ps(ai, b1, c41);
+        ai = _mm256_broadcast_ss(a + 5);
+        c50 = _mm256_fmadd_ps(ai, b0, c50); c51 = _mm256_fmadd_ps(ai, b1, c51);
+
+        a += 6;
+        b += 16;
+    }
+
+    __m256 acc[12] = { c00, c01, c10, c11, c20, c21, c30, c31, c40, c41, c50, c51 };
+
+    if (mr == 6 && nr == 16) {
+        for (int i = 0; i < 6; i++) {
+            float* Ci = C + i*ldc;
+            _mm256_storeu_ps(Ci,     _mm256_add_ps(_mm256_loadu_ps(Ci),     acc[2*i]));
+            _mm256_storeu_ps(Ci + 8, _mm256_add_ps(_mm256_loadu_ps(Ci + 8), acc[2*i+1]));
+        }
+    }
+    else {
+        float ab[6 * 16];
+        for (int i = 0; i < 12; i++)
+            _mm256_storeu_ps(ab + 8*i, acc[i]);
+        add_tile(ab, 16, C, ldc, mr, nr);
+    }
+}
+
+// ----------------------------------------------------------------
+//
+//  AVX-512 6x32 kernel: 12 zmm accumulators, same shape of loop
+//  as the AVX2 kernel with twice the width
+//
+// ----------------------------------------------------------------
+__attribute__((target("avx512f")))
+static void ukernel_avx512_6x32(int kc, const float* a, const float* b,
+                                float* C, int ldc, int mr, int nr)
+{
+    __m512 c00 = _mm512_setzero_ps(), c01 = _mm512_setzero_ps();
+    __m512 c10 = _mm512_setzero_ps(), c11 = _mm512_setzero_ps();
+    __m512 c20 = _mm512_setzero_ps(), c21 = _mm512_setzero_ps();
+    __m512 c30 = _mm512_setzero_ps(), c31 = _mm512_setzero_ps();
+    __m512 c40 = _mm512_setzero_ps(), c41 = _mm512_setzero_ps();
+    __m512 c50 = _mm512_setzero_ps(), c51 = _mm512_setzero_ps();
+
+    for (int p = 0; p < kc; p++) {
+        __m512 b0 = _mm512_loadu_ps(b);
+        __m512 b1 = _mm512_loadu_ps(b + 16);
+        __m512 ai;
+
+        ai = _mm512_set1_ps(a[0]);
+        c00 = _mm512_fmadd_ps(ai, b0, c00); c01 = _mm512_fmadd_ps(ai, b1, c01);
+        ai = _mm512_set1_ps(a[1]);
+        c10 = _mm512_fmadd_ps(ai, b0, c10); c11 = _mm512_fmadd_ps(ai, b1, c11);
+        ai = _mm512_set1_ps(a[2]);
+        c20 = _mm512_fmadd_ps(ai, b0, c20); c21 = _mm512_fmadd_ps(ai, b1, c21);
+        ai = _mm512_set1_ps(a[3]);
+        c30 = _mm512_fmadd_ps(ai, b0, c30); c31 = _mm512_fmadd_ps(ai, b1, c31);
+        ai = _mm512_set1_ps(a[4]);
+        c40 = _mm512_fmadd_ps(ai, b0, c40); c41 = _mm512_fmadd_ps(ai, b1, c41);
+        ai = _mm512_set1_ps(a[5]);
+        c50 = _mm512_fmadd_ps(ai, b0, c50); c51 = _mm512_fmadd_ps(ai, b1, c51);
+
+        a += 6;
+        b += 32;
+    }
+
+    __m512 acc[12] = { c00, c01, c10, c11, c20, c21, c30, c31, c40, c41, c50, c51 };
+
+    if (mr == 6 && nr == 32) {
+        for (int i = 0; i < 6; i++) {
+            float* Ci = C + i*ldc;
+            _mm512_storeu_ps(Ci,      _mm512_add_ps(_mm512_loadu_ps(Ci),      acc[2*i]));
+            _mm512_storeu_ps(Ci + 16, _mm512_add_ps(_mm512_loadu_ps(Ci + 16), acc[2*i+1]));
+        }
+    }
+    else {
+        float ab[6 * 32];
+        for (int i = 0; i < 12; i++)
+            _mm512_storeu_ps(ab + 16*i, acc[i]);
+        add_tile(ab, 32, C, ldc, mr, nr);
+    }
+}
+
+#endif // GEMM_X86_SIMD
+
+// ----------------------------------------------------------------
+//
+//  Run time dispatch
+//
+// ----------------------------------------------------------------
+
+static const gemm_ukernel ukernel_scalar = { "scalar", 6, 16, ukernel_scalar_6x16 };
+#ifdef GEMM_X86_SIMD
+static const gemm_ukernel ukernel_avx2   = { "avx2",   6, 16, ukernel_avx2_6x16 };
+static const gemm_ukernel ukernel_avx512 = { "avx512", 6, 32, ukernel_avx512_6x32 };
+#endif
+
+static const gemm_ukernel* current_ukernel = 0;
+
+// Returns the named kernel if the CPU can run it, NULL otherwise
+static const gemm_ukernel* find_ukernel(const char* name)
+{
+    bool any = !strcmp(name, "auto");
+#ifdef GEMM_X86_SIMD
+    __builtin_cpu_init();
+    if ((any || !strcmp(name, "avx512")) && __builtin_cpu_supports("avx512f"))
+        return &ukernel_avx512;
+    if ((any || !strcmp(name, "avx2")) && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return &ukernel_avx2;
+#endif
+    if (any || !strcmp(name, "scalar"))
+        return &ukernel_scalar;
+    return 0;
+}
+
+const gemm_ukernel& get_gemm_ukernel()
+{
+    if (!current_ukernel)
+        current_ukernel = find_ukernel("auto");
+    return *current_ukernel;
+}
+
+bool set_gemm_ukernel(const char* name)
+{
+    const gemm_ukernel* k = find_ukernel(name);
+    if (k)
+        current_ukernel = k;
+    return k != 0;
+}
@@ -0,0 +1,46 @@
+/* ----------------------------------------------------------------
+**
+**  Micro-kernels of the blocked host GEMM (see matrix_lib.cpp)
+**
+**  A micro-kernel computes C(mr x nr) += a(MR x kc) * b(kc x NR)
+**  where a and b are packed micro-panels: a holds MR consecutive
+**  elements per step p, b holds NR. mr <= MR and nr <= NR give the
+**  part of the register tile which lies inside C.
+**
+** ----------------------------------------------------------------
+*/
+
+#ifndef __MATRIX_KERNELS_HDR
+#define __MATRIX_KERNELS_HDR
+
+typedef void (*gemm_ukernel_fn)(int kc, const float* a, const float* b,
+                                float* C, int ldc, int mr, int nr);
+
+struct gemm_ukernel
+{
+    const char*     name; // "scalar", "avx2", "avx512"
+    int             mr;   // rows of the register tile
+    int             nr;   // columns of the register tile
+    gemm_ukernel_fn fn;
+};
+
+/* ----------------------------------------------------------------
+**
+**  Returns the micro-kernel used by the blocked GEMM. The first
+**  call picks the widest one supported by the CPU, unless one was
+**  forced with set_gemm_ukernel.
+**
+** ----------------------------------------------------------------
+*/
+const gemm_ukernel& get_gemm_ukernel();
+
+/* ----------------------------------------------------------------
+**
+**  Forces the micro-kernel ("scalar", "avx2", "avx512" or "auto").
+**  Returns false if it is unknown or not supported by the CPU.
+**
+** ----------------------------------------------------------------
+*/
+bool set_gemm_ukernel(const char* name);
+
+#endif
@@ -12,6 +12,13 @@
 */
 
 #include "matmul.hpp"
+#include "matrix_kernels.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
 
 // ----------------------------------------------------------------
 //
@@ -36,6 +43,317 @@ void seq_mat_mul_sdot(int N, std::vector<float>& A, std::vector<float>& B, std::
     }
 }
 
+// ----------------------------------------------------------------
+//
+//  Blocked host GEMM
+//
+//  The product is split in the classic GotoBLAS way:
+//
+//    for jc (NC columns of B and C)        -> B panel lives in L3
+//      for pc (KC rows of B / cols of A)   -> packed B panel
+//        for ic (MC rows of A and C)       -> A block lives in L2
+//          for jr (NR cols), ir (MR rows)  -> micro-kernel, in L1
+//
+//  A and B are copied ("packed") into contiguous micro-panels so that
+//  the micro-kernel (matrix_kernels.cpp) only streams through unit
+//  stride memory. The ic loop is shared between the host threads.
+//
+// ----------------------------------------------------------------
+
+#define GEMM_KC 256   // depth of the packed panels
+#define GEMM_MC 144   // max rows of the packed block of A (L2)
+#define GEMM_NC 4096  // max columns of the packed panel of B (L3)
+
+// Number of threads used by the blocked host GEMM (0 = all cores)
+static int gemm_threads = 0;
+
+void set_host_threads(int nthreads)
+{
+    gemm_threads = nthreads;
+}
+
+int get_host_threads()
+{
+    if (gemm_threads > 0)
+        return gemm_threads;
+    int n = std::thread::hardware_concurrency();
+    return n > 0 ? n : 1;
+}
+
+// Runs fn(0) .. fn(nthreads-1), fn(0) on the calling thread
+static void run_threads(int nthreads, const std::function<void(int)>& fn)
+{
+    std::vector<std::thread> workers;
+    for (int t = 1; t < nthreads; t++)
+        workers.push_back(std::thread(fn, t));
+    fn(0);
+    for (size_t t = 0; t < workers.size(); t++)
+        workers[t].join();
+}
+
+// Barrier of the nthreads threads of run_threads, reusable
+class ThreadBarrier
+{
+    public:
+        explicit ThreadBarrier(int nthreads) : nthreads_(nthreads), waiting_(0), generation_(0) {}
+
+        void wait()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            unsigned generation = generation_;
+            if (++waiting_ == nthreads_) {
+                waiting_ = 0;
+                generation_++;
+                released_.notify_all();
+            }
+            else
+                released_.wait(lock, [&]() { return generation_ != generation; });
+        }
+
+    private:
+        std::mutex              mutex_;
+        std::condition_variable released_;
+        int                     nthreads_;
+        int                     waiting_;
+        unsigned                generation_;
+};
+
+// Packs alpha times the mc x kc block of A starting at A into MR-row
+// micro-panels. Element (i,p) of the block is A[i*rsA + p*csA]; the last
+// micro-panel is padded with zeros. Strides are size_t so that offsets
+// past 2^31 elements do not overflow.
+static void pack_A(int MR, int mc, int kc, float alpha, const float* A, size_t rsA, size_t csA, float* buf)
+{
+    for (int ir = 0; ir < mc; ir += MR) {
+        int mr = std::min(MR, mc - ir);
+        for (int p = 0; p < kc; p++) {
+            for (int i = 0; i < mr; i++)
+                buf[i] = alpha * A[(ir+i)*rsA + p*csA];
+            for (int i = mr; i < MR; i++)
+                buf[i] = 0.0f;
+            buf += MR;
+        }
+    }
+}
+
+// Packs the kc x nc panel of B starting at B into NR-column micro-panels.
+// Element (p,j) of the panel is B[p*rsB + j*csB].
+static void pack_B(int NR, int kc, int nc, const float* B, size_t rsB, size_t csB, float* buf)
+{
+    for (int jr = 0; jr < nc; jr += NR) {
+        int nr = std::min(NR, nc - jr);
+        for (int p = 0; p < kc; p++) {
+            for (int j = 0; j < nr; j++)
+                buf[j] = B[p*rsB + (jr+j)*csB];
+            for (int j = nr; j < NR; j++)
+                buf[j] = 0.0f;
+            buf += NR;
+        }
+    }
+}
+
+// C(M x N, row major, leading dimension ldc) += alpha * A(M x K) * B(K x N)
+// where A(i,k) = A[i*rsA + k*csA] and B(k,j) = B[k*rsB + j*csB]
+static void gemm_blocked(int M, int N, int K, float alpha,
+                         const float* A, size_t rsA, size_t csA,
+                         const float* B, size_t rsB, size_t csB,
+                         float* C, size_t ldc)
+{
+    if (M <= 0 || N <= 0 || K <= 0)
+        return;
+
+    // Register tile shape depends on the micro-kernel picked at run time
+    const gemm_ukernel& uk = get_gemm_ukernel();
+    const int MR = uk.mr;
+    const int NR = uk.nr;
+    const int NC = GEMM_NC / NR * NR;
+
+    int nthreads = get_host_threads();
+
+    // Shrink the A block so that every thread gets at least one
+    int mc = (M + nthreads - 1) / nthreads;
+    mc = (mc + MR - 1) / MR * MR;
+    mc = std::min(mc, GEMM_MC / MR * MR);
+    int mblocks = (M + mc - 1) / mc;
+    nthreads = std::min(nthreads, mblocks);
+
+    std::vector<float> packedB(GEMM_KC * NC);
+    std::vector<std::vector<float> > packedA(nthreads, std::vector<float>(mc * GEMM_KC));
+
+    // One team of threads for the whole product, in step through the
+    // panels of B: the panel is complete before anyone multiplies by it,
+    // and everyone is done with it before it is packed again
+    ThreadBarrier barrier(nthreads);
+    run_threads(nthreads, [&](int t) {
+        float* bufA = &packedA[t][0];
+
+        for (int jc = 0; jc < N; jc += NC) {
+            int nc = std::min(NC, N - jc);
+            int npanels = (nc + NR - 1) / NR;
+
+            for (int pc = 0; pc < K; pc += GEMM_KC) {
+                int kc = std::min(GEMM_KC, K - pc);
+
+                // Pack the B panel, one slice of micro-panels per thread
+                for (int jp = t; jp < npanels; jp += nthreads) {
+                    int jr = jp * NR;
+                    pack_B(NR, kc, std::min(NR, nc - jr),
+                           &B[pc*rsB + (jc+jr)*csB], rsB, csB,
+                           &packedB[jp * NR * kc]);
+                }
+                barrier.wait();
+
+                // Each thread packs and multiplies its own blocks of A
+                for (int ib = t; ib < mblocks; ib += nthreads) {
+                    int ic = ib * mc;
+                    int mcur = std::min(mc, M - ic);
+                    pack_A(MR, mcur, kc, alpha, &A[ic*rsA + pc*csA], rsA, csA, bufA);
+
+                    for (int jr = 0; jr < nc; jr += NR) {
+                        int nr = std::min(NR, nc - jr);
+                        const float* b = &packedB[jr * kc];
+                        for (int ir = 0; ir < mcur; ir += MR) {
+                            int mr = std::min(MR, mcur - ir);
+                            uk.fn(kc, &bufA[ir * kc], b,
+                                  &C[(ic+ir)*ldc + jc+jr], (int) ldc, mr, nr);
+                        }
+                    }
+                }
+                barrier.wait();
+            }
+        }
+    });
+}
+
+// ----------------------------------------------------------------
+//
+//  General matrix product on the host (row major storage)
+//
+//      C = alpha * op(A) * op(B) + beta * C
+//
+// ----------------------------------------------------------------
+
+void gemm(char transA, char transB, int M, int N, int K,
+          float alpha, const float* A, int lda,
+          const float* B, int ldb,
+          float beta, float* C, int ldc)
+{
+    if (M <= 0 || N <= 0)
+        return;
+
+    // C = beta * C, without reading C when beta is 0 (it may hold NaNs)
+    if (beta != 1.0f) {
+        for (int i = 0; i < M; i++)
+            for (int j = 0; j < N; j++)
+                C[(size_t) i*ldc+j] = (beta == 0.0f) ? 0.0f : beta * C[(size_t) i*ldc+j];
+    }
+
+    if (alpha == 0.0f || K <= 0)
+        return;
+
+    // op(A)(i,k) and op(B)(k,j) are read through strides, transposing
+    // is free since the blocked product packs its operands anyway
+    bool tA = (transA == 'T' || transA == 't');
+    bool tB = (transB == 'T' || transB == 't');
+    gemm_blocked(M, N, K, alpha,
+                 A, tA ? 1 : lda, tA ? lda : 1,
+                 B, tB ? 1 : ldb, tB ? ldb : 1,
+                 C, ldc);
+}
+
+// C(M x N) = alpha * A(M x K) * B(K x N) + beta * C for small matrices,
+// strides as in gemm_blocked. Rows of C are updated in place so that
+// the inner loop runs along contiguous rows of B and C.
+static void gemm_small(int M, int N, int K, float alpha,
+                       const float* A, size_t rsA, size_t csA,
+                       const float* B, size_t rsB, size_t csB,
+                       float beta, float* C, size_t ldc)
+{
+    for (int i = 0; i < M; i++) {
+        float* c = &C[i*ldc];
+        for (int j = 0; j < N; j++)
+            c[j] = (beta == 0.0f) ? 0.0f : beta * c[j];
+        for (int k = 0; k < K; k++) {
+            float a = alpha * A[i*rsA + k*csA];
+            const float* b = &B[k*rsB];
+            for (int j = 0; j < N; j++)
+                c[j] += a * b[j*csB];
+        }
+    }
+}
+
+// Products 0 .. batch-1, each thread taking a contiguous range of the
+// batch; operands(b, &A, &B, &C) gives the matrices of product b
+static void gemm_batch(char transA, char transB, int M, int N, int K,
+                       float alpha, int lda, int ldb, float beta, int ldc, int batch,
+                       const std::function<void(int, const float**, const float**, float**)>& operands)
+{
+    if (M <= 0 || N <= 0 || batch <= 0)
+        return;
+
+    bool tA = (transA == 'T' || transA == 't');
+    bool tB = (transB == 'T' || transB == 't');
+    int nthreads = std::min(get_host_threads(), batch);
+
+    run_threads(nthreads, [&](int t) {
+        for (int b = batch * t / nthreads; b < batch * (t + 1) / nthreads; b++) {
+            const float* A;
+            const float* B;
+            float* C;
+            operands(b, &A, &B, &C);
+            gemm_small(M, N, K, alpha,
+                       A, tA ? 1 : lda, tA ? lda : 1,
+                       B, tB ? 1 : ldb, tB ? ldb : 1,
+                       beta, C, ldc);
+        }
+    });
+}
+
+// ----------------------------------------------------------------
+//
+//  Batched products of small matrices on the host
+//
+// ----------------------------------------------------------------
+
+void gemm_batched_strided(char transA, char transB, int M, int N, int K,
+                          float alpha, const float* A, int lda, long long strideA,
+                          const float* B, int ldb, long long strideB,
+                          float beta, float* C, int ldc, long long strideC,
+                          int batch)
+{
+    gemm_batch(transA, transB, M, N, K, alpha, lda, ldb, beta, ldc, batch,
+               [&](int b, const float** a, const float** bb, float** c) {
+        *a = A + b * strideA;
+        *bb = B + b * strideB;
+        *c = C + b * strideC;
+    });
+}
+
+void gemm_batched(char transA, char transB, int M, int N, int K,
+                  float alpha, const float* const* A, int lda,
+                  const float* const* B, int ldb,
+                  float beta, float* const* C, int ldc,
+                  int batch)
+{
+    gemm_batch(transA, transB, M, N, K, alpha, lda, ldb, beta, ldc, batch,
+               [&](int b, const float** a, const float** bb, float** c) {
+        *a = A[b];
+        *bb = B[b];
+        *c = C[b];
+    });
+}
+
+// ----------------------------------------------------------------
+//
+//  Function to compute the matrix product (blocked, multithreaded)
+//
+// ----------------------------------------------------------------
+
+void blocked_mat_mul(int N, std::vector<float>& A, std::vector<float>& B, std::vector<float>& C)
+{
+    gemm('N', 'N', N, N, N, 1.0f, &A[0], N, &B[0], N, 0.0f, &C[0], N);
+}
+
 // ----------------------------------------------------------------
 //
 //  Function to initialize the input matrices A and B
@@ -17,6 +17,67 @@
 */
 void seq_mat_mul_sdot(int N, std::vector<float> &A, std::vector<float> &B, std::vector<float> &C);
 
+/* ----------------------------------------------------------------
+**
+**  Function to compute the matrix product (cache blocked, packed
+**  panels, multithreaded)
+**
+** ----------------------------------------------------------------
+*/
+void blocked_mat_mul(int N, std::vector<float> &A, std::vector<float> &B, std::vector<float> &C);
+
+/* ----------------------------------------------------------------
+**
+**  General matrix product on the host, C = alpha*op(A)*op(B) + beta*C
+**
+**  Matrices are stored by rows with leading dimensions lda, ldb, ldc.
+**  op(X) is X for trans 'N' and its transpose for 'T', op(A) is
+**  M x K, op(B) is K x N and C is M x N.
+**
+** ----------------------------------------------------------------
+*/
+void gemm(char transA, char transB, int M, int N, int K,
+          float alpha, const float* A, int lda,
+          const float* B, int ldb,
+          float beta, float* C, int ldc);
+
+/* ----------------------------------------------------------------
+**
+**  Batched products of small matrices on the host, same conventions
+**  as gemm, for b = 0 .. batch-1:
+**
+**      C_b = alpha*op(A_b)*op(B_b) + beta*C_b
+**
+**  gemm_batched_strided: X_b = X + b*strideX (one array per operand)
+**  gemm_batched:         X_b = X[b]          (arrays of pointers)
+**
+**  The batch is shared between the host threads, each product being
+**  computed directly, without packing.
+**
+** ----------------------------------------------------------------
+*/
+void gemm_batched_strided(char transA, char transB, int M, int N, int K,
+                          float alpha, const float* A, int lda, long long strideA,
+                          const float* B, int ldb, long long strideB,
+                          float beta, float* C, int ldc, long long strideC,
+                          int batch);
+
+void gemm_batched(char transA, char transB, int M, int N, int K,
+                  float alpha, const float* const* A, int lda,
+                  const float* const* B, int ldb,
+                  float beta, float* const* C, int ldc,
+                  int batch);
+
+/* ----------------------------------------------------------------
+**
+**  Number of host threads used by gemm, gemm_batched* and
+**  blocked_mat_mul (0 = all cores)
+**
+** ----------------------------------------------------------------
+*/
+void set_host_threads(int nthreads);
+int get_host_threads();
+
 /* ----------------------------------------------------------------
 **
 **  Function to initialize the input matrices A and B
@@ -0,0 +1,124 @@
+/* ----------------------------------------------------------------
+**
+**  PROGRAM: Matrix product on several OpenCL devices
+**
+**  PURPOSE: Row panels of C computed concurrently by every device,
+**           see multigemm.hpp.
+**
+** ----------------------------------------------------------------
+*/
+
+#include "multigemm.hpp"
+#include "profiling.hpp"
+
+#include <algorithm>
+
+MultiGemm::Device::Device(const cl::Device& device)
+    : context(std::vector<cl::Device>(1, device)),
+      queue(util::makeQueue(context, device)),
+      gemm(context, device),
+      bytesA(0), bytesB(0), bytesC(0), rows(0), gflops(0.0)
+{
+    name = device.getInfo<CL_DEVICE_NAME>();
+}
+
+MultiGemm::MultiGemm(const std::vector<cl::Device>& devices)
+{
+    for (size_t d = 0; d < devices.size(); d++)
+        devices_.push_back(Device(devices[d]));
+}
+
+std::vector<int> MultiGemm::split(int M) const
+{
+    size_t n = devices_.size();
+    std::vector<int> rows(n, 0);
+
+    // Until every device has been measured, whole panels of TS rows
+    // shared evenly, the devices not measured yet first: each of them
+    // gets a panel as soon as there are enough panels to go round
+    std::vector<size_t> order;
+    for (size_t d = 0; d < n; d++)
+        if (devices_[d].gflops <= 0.0)
+            order.push_back(d);
+    if (!order.empty())
+    {
+        for (size_t d = 0; d < n; d++)
+            if (devices_[d].gflops > 0.0)
+                order.push_back(d);
+        int panels = (M + TS - 1) / TS, left = M;
+        for (size_t i = 0; i < n; i++)
+        {
+            int p = (int) ((panels + n - 1 - i) / n);
+            rows[order[i]] = std::min(left, p * TS);
+            left -= rows[order[i]];
+        }
+        return rows;
+    }
+
+    double total = 0.0;
+    for (size_t d = 0; d < n; d++)
+        total += devices_[d].gflops;
+
+    // Whole panels of TS rows, the last device takes what is left
+    int left = M;
+    for (size_t d = 0; d + 1 < n && left > 0; d++)
+    {
+        int r = (int) (M * devices_[d].gflops / total + 0.5);
+        r = std::min(left, (r + TS / 2) / TS * TS);
+        rows[d] = r;
+        left -= r;
+    }
+    rows[n - 1] = left;
+    return rows;
+}
+
+void MultiGemm::operator()(int M, int N, int K, const float* A, const float* B, float* C)
+{
+    std::vector<int> rows = split(M);
+    std::vector<cl::Event> first(devices_.size()), last(devices_.size());
+
+    // Enqueue every panel before waiting for any
+    int row = 0;
+    for (size_t d = 0; d < devices_.size(); d++)
+    {
+        Device& dev = devices_[d];
+        dev.rows = rows[d];
+        if (rows[d] == 0)
+            continue;
+
+        size_t bytesA = sizeof(float) * rows[d] * K;
+        size_t bytesB = sizeof(float) * K * N;
+        size_t bytesC = sizeof(float) * rows[d] * N;
+        if (bytesA > dev.bytesA)
+            dev.a = cl::Buffer(dev.context, CL_MEM_READ_ONLY, dev.bytesA = bytesA);
+        if (bytesB > dev.bytesB)
+            dev.b = cl::Buffer(dev.context, CL_MEM_READ_ONLY, dev.bytesB = bytesB);
+        if (bytesC > dev.bytesC)
+            dev.c = cl::Buffer(dev.context, CL_MEM_WRITE_ONLY, dev.bytesC = bytesC);
+
+        dev.queue.enqueueWriteBuffer(dev.a, CL_FALSE, 0, bytesA, A + (size_t) row * K, NULL, &first[d]);
+        dev.queue.enqueueWriteBuffer(dev.b, CL_FALSE, 0, bytesB, B);
+        dev.gemm(dev.queue, 'N', 'N', rows[d], N, K, 1.0f, dev.a, K, dev.b, N, 0.0f, dev.c, N);
+        dev.queue.enqueueReadBuffer(dev.c, CL_FALSE, 0, bytesC, C + (size_t) row * N, NULL, &last[d]);
+        dev.queue.flush();
+
+        row += rows[d];
+    }
+
+    // Gather, and measure each device for the next split: the mean of
+    // the last two measures, to smooth out the noise. A panel of less
+    // than TS rows is too small to tell the speed of a device.
+    for (size_t d = 0; d < devices_.size(); d++)
+    {
+        Device& dev = devices_[d];
+        if (rows[d] == 0)
+            continue;
+        dev.queue.finish();
+        if (rows[d] < TS)
+            continue;
+
+        double seconds = util::getEventTimes(first[d], last[d]).total();
+        double gflops = seconds > 0.0 ? 2.0 * rows[d] * N * K / seconds * 1e-9 : 0.0;
+        dev.gflops = dev.gflops > 0.0 ? 0.5 * (dev.gflops + gflops) : gflops;
+    }
+}
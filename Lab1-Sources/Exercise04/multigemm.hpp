@@ -0,0 +1,71 @@
+/* ----------------------------------------------------------------
+**
+**  Matrix product on several OpenCL devices at once
+**
+**      C = A * B
+**
+**  C is cut into row panels, one per device: each device gets its
+**  rows of A and the whole of B, computes its panel with the gemm
+**  kernel (CLGemm) on its own context and queue, and the panels are
+**  read back into C. All devices run concurrently.
+**
+**  The rows are shared in proportion to the throughput measured on
+**  each device during the previous products (upload, kernel and
+**  download), so that a slow device does not hold back the others.
+**  Until every device has run a panel of at least TS rows, they are
+**  shared evenly, the devices not measured yet served first. Panels
+**  are whole multiples of TS rows.
+**
+**  Host matrices are row major, as in matrix_lib.hpp.
+**
+** ----------------------------------------------------------------
+*/
+
+#ifndef __MULTIGEMM_HDR
+#define __MULTIGEMM_HDR
+
+#include "clgemm.hpp"
+
+#include <string>
+#include <vector>
+
+class MultiGemm
+{
+    public:
+        //! One context, queue and gemm kernel per device
+        explicit MultiGemm(const std::vector<cl::Device>& devices);
+
+        //! C(M x N) = A(M x K) * B(K x N), blocking
+        void operator()(int M, int N, int K, const float* A, const float* B, float* C);
+
+        size_t deviceCount() const { return devices_.size(); }
+        const std::string& name(size_t d) const { return devices_[d].name; }
+
+        //! Rows of C given to device d by the last product
+        int rows(size_t d) const { return devices_[d].rows; }
+
+        //! GFLOPS of device d on its panel, uploads and downloads included
+        double gflops(size_t d) const { return devices_[d].gflops; }
+
+    private:
+        struct Device
+        {
+            std::string      name;
+            cl::Context      context;
+            cl::CommandQueue queue;
+            CLGemm           gemm;
+            cl::Buffer       a, b, c;   // grown to the largest product so far
+            size_t           bytesA, bytesB, bytesC;
+            int              rows;
+            double           gflops;    // 0 until measured
+
+            Device(const cl::Device& device);
+        };
+
+        //! Rows of C for each device, from the measured throughputs
+        std::vector<int> split(int M) const;
+
+        std::vector<Device> devices_;
+};
+
+#endif
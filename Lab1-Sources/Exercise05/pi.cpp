@@ -5,40 +5,151 @@
  **           4/(1+x*x)
  **
  **           from 0 to 1. The value of this integral is pi.
- **           The is the original sequential program. It uses the timer
- **           from the OpenMP runtime library
+ **           The integral goes through util::integrate (integrate.hpp)
+ **           with each of its policies: a sequential loop on the host,
+ **           threaded and vectorised blocks on the host, then the
+ **           kernel of integrate.cl on the OpenCL device, where each
+ **           work-group reduces its sums in local memory and the host
+ **           adds up the sums of the groups.
  **
- **  USAGE: ./pi
+ **  USAGE: ./pi [--device INDEX] [--size STEPS] [--threads N]
+ **              [--variant seq|threads|device|all]
  **
  */
 
+#define __CL_ENABLE_EXCEPTIONS
+#include "cl.hpp"
+
 #include "util.hpp"
+#include "device_picker.hpp"
+#include "integrate.hpp"
+#include <err_code.h>
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
-static long num_steps = 100000000;
-double step;
+#include <string>
+#include <thread>
+#include <vector>
+
+static long long num_steps = 100000000;
 extern double wtime();   // returns time since some fixed past point (wtime.c)
 
-int main ()
+// The integrand, for the host and as OpenCL C for the device
+struct PiIntegrand
+{
+    double operator()(double x) const { return 4.0/(1.0+x*x); }
+    static const char* opencl() { return "4.0/(1.0+x*x)"; }
+};
+
+int main (int argc, char *argv[])
 {
-    int i;
+    double pi;
+
+    cl_uint deviceIndex = 2;
+    RunOptions options(num_steps, 0, 1);
+    options.variant = "all";
+
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    options.addNumber("--threads", "N", "Threads of the threaded integration", &threads, 1, 1024);
+    try
+    {
+        parseArguments(argc, argv, &deviceIndex, &options);
+    }
+    catch (cl::Error err)
+    {
+        std::cerr << "ERROR: " << err.what() << "(" << err_code(err.err()) << ")" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    int nthreads = (int) threads;
 
-    double x, pi, sum = 0.0;
+    num_steps = options.sizes[0];
 
+    // ------------------------------------------------------------------
+    // Sequential integration on the host
+    // ------------------------------------------------------------------
 
-    step = 1.0/(double) num_steps;
+    if (options.variant == "all" || options.variant == "seq")
+    {
+        util::Timer timer;
 
-    util::Timer timer;
+        pi = util::integrate<PiIntegrand>(0.0, 1.0, num_steps, util::Sequential());
 
-    for (i=1;i<= num_steps; i++){
-        x = (i-0.5)*step;
-        sum = sum + 4.0/(1.0+x*x);
+        double run_time = static_cast<double>(timer.getTimeMilliseconds()) / 1000.0;
+        std::cout<<"pi with "<<num_steps<<" steps is "
+            << pi <<" in "
+            <<run_time<<" seconds"<<std::endl;
     }
 
-    pi = step * sum;
-    double run_time = static_cast<double>(timer.getTimeMilliseconds()) / 1000.0;
-    std::cout<<"pi with "<<num_steps<<" steps is "
-        << pi <<" in "
-        <<run_time<<" seconds"<<std::endl;
-}
+    // ------------------------------------------------------------------
+    // Threaded and vectorised integration on the host
+    // ------------------------------------------------------------------
+
+    if (options.variant == "all" || options.variant == "threads")
+    {
+        util::Timer timer;
+
+        pi = util::integrate<PiIntegrand>(0.0, 1.0, num_steps, util::Threaded(nthreads));
+
+        double run_time = static_cast<double>(timer.getTimeMilliseconds()) / 1000.0;
+        std::cout<<"pi with "<<num_steps<<" steps is "
+            << pi <<" in "
+            <<run_time<<" seconds ("<<nthreads<<" threads)"<<std::endl;
+    }
 
+    if (options.variant != "all" && options.variant != "device")
+        return EXIT_SUCCESS;
+
+    // ------------------------------------------------------------------
+    // Parallel integration on the OpenCL device
+    // ------------------------------------------------------------------
+
+    try
+    {
+        // Get list of devices
+        std::vector<cl::Device> devices;
+        unsigned numDevices = getDeviceList(devices);
+
+        // Check device index in range
+        if (deviceIndex >= numDevices)
+        {
+            std::cout << "Invalid device index (try '--list')\n";
+            return EXIT_FAILURE;
+        }
+
+        cl::Device device = devices[deviceIndex];
+
+        std::string name;
+        getDeviceName(device, name);
+        std::cout << "\nUsing OpenCL device: " << name << "\n";
+
+        std::vector<cl::Device> chosen_device;
+        chosen_device.push_back(device);
+        cl::Context context(chosen_device);
+        cl::CommandQueue queue = util::makeQueue(context, device);
+
+        util::OpenCLDevice integrator(context, device, queue);
+
+        util::Timer timer;
+
+        pi = util::integrate<PiIntegrand>(0.0, 1.0, num_steps, integrator);
+
+        double run_time = static_cast<double>(timer.getTimeMilliseconds()) / 1000.0;
+        std::cout<<"pi with "<<num_steps<<" steps is "
+            << pi <<" in "
+            <<run_time<<" seconds ("
+            <<integrator.deviceTime()<<" seconds on the device, in "
+            <<(integrator.doublePrecision() ? "double" : "float")<<")"<<std::endl;
+    }
+    catch (cl::Error err)
+    {
+        std::cout << "Exception\n";
+        std::cerr << "ERROR: "
+                  << err.what()
+                  << "("
+                  << err_code(err.err())
+                  << ")"
+                  << std::endl;
+    }
+}